@@ -0,0 +1,282 @@
+#include "asset_index.hpp"
+
+#include <AL/al.h>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <sndfile.h>
+#include <stdexcept>
+#include <thread>
+
+#include "binary_file.hpp"
+#include "load_sound_file.hpp"
+
+namespace {
+
+constexpr char index_magic[4] = {'S', 'A', 'I', 'X'};
+constexpr uint32_t index_version = 1;
+
+struct IndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_entries;
+    uint32_t string_table_size;
+};
+
+struct EntryRecord {
+    uint32_t path_offset; // into the string table
+    uint32_t path_length;
+    int64_t frames;
+    uint64_t projected_bytes;
+    int32_t channels;
+    int32_t sample_rate;
+    int32_t sndfile_format;
+    int32_t byte_block_alignment;
+    int32_t samples_per_block;
+    uint8_t ambisonic_order;
+    uint8_t problem;
+    uint8_t padding[2] = {};
+};
+
+static_assert(sizeof(IndexHeader) == 16 && sizeof(EntryRecord) == 48);
+
+bool has_plain_multichannel_format(int channels) {
+    return channels == 4 || channels == 6 || channels == 7 || channels == 8;
+}
+
+AssetIndexEntry scan_sound_asset(const std::string &path) {
+    AssetIndexEntry entry;
+    entry.path = path;
+
+    SF_INFO sound_file_info{};
+    SoundFileHandle sound_file(sf_open(path.c_str(), SFM_READ, &sound_file_info));
+    if (!sound_file) {
+        entry.problem = AssetProblem::cant_open;
+        return entry;
+    }
+    entry.channels = sound_file_info.channels;
+    entry.sample_rate = sound_file_info.samplerate;
+    entry.frames = sound_file_info.frames;
+    entry.sndfile_format = sound_file_info.format;
+
+    int channels = sound_file_info.channels;
+    if (channels > 2) {
+        bool ambisonic = sf_command(sound_file.get(), SFC_WAVEX_GET_AMBISONIC, NULL, 0) == SF_AMBISONIC_B_FORMAT;
+        if (ambisonic) {
+            bool three_dimensional;
+            entry.ambisonic_order = get_ambisonic_order(channels, three_dimensional);
+        }
+        if (ambisonic ? entry.ambisonic_order == 0 : !has_plain_multichannel_format(channels)) {
+            entry.problem = AssetProblem::unsupported_channels;
+        }
+    }
+
+    // the same test the loader makes before loading an ADPCM wav without decoding it
+    int subformat = sound_file_info.format & SF_FORMAT_SUBMASK;
+    bool adpcm = (subformat == SF_FORMAT_IMA_ADPCM || subformat == SF_FORMAT_MS_ADPCM) && channels <= 2 &&
+                 (sound_file_info.format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV;
+    ALint byte_block_alignment = 0;
+    ALint samples_per_block = 0;
+    if (adpcm && read_adpcm_block_alignment(sound_file.get(), channels, subformat == SF_FORMAT_IMA_ADPCM,
+                                            byte_block_alignment, samples_per_block)) {
+        entry.byte_block_alignment = byte_block_alignment;
+        entry.samples_per_block = samples_per_block;
+    }
+    sound_file.reset();
+
+    if (entry.problem == AssetProblem::none && entry.frames < 1) {
+        entry.problem = AssetProblem::no_samples;
+    }
+    if (entry.problem != AssetProblem::none) {
+        return entry;
+    }
+
+    uint64_t frames = (uint64_t)entry.frames;
+    if (entry.samples_per_block > 0) {
+        uint64_t num_blocks = (frames + entry.samples_per_block - 1) / entry.samples_per_block;
+        entry.projected_bytes = num_blocks * entry.byte_block_alignment;
+    } else {
+        uint64_t sample_size = is_float_source_format(entry.sndfile_format) ? sizeof(float) : sizeof(short);
+        entry.projected_bytes = frames * channels * sample_size;
+    }
+    if (entry.projected_bytes > INT_MAX) {
+        entry.problem = AssetProblem::too_large;
+    }
+    return entry;
+}
+
+} // namespace
+
+const char *get_asset_problem_name(AssetProblem problem) {
+    switch (problem) {
+    case AssetProblem::none:
+        return "none";
+    case AssetProblem::cant_open:
+        return "can't be opened";
+    case AssetProblem::no_samples:
+        return "has no samples";
+    case AssetProblem::unsupported_channels:
+        return "has an unsupported channel layout";
+    case AssetProblem::too_large:
+        return "is too large for a buffer";
+    }
+    return "unknown";
+}
+
+std::vector<AssetIndexEntry> scan_sound_assets(const std::vector<std::string> &paths, unsigned num_threads) {
+    std::vector<AssetIndexEntry> entries(paths.size());
+
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::min<unsigned>(num_threads, (unsigned)paths.size());
+    if (num_threads <= 1) {
+        for (size_t i = 0; i < paths.size(); i++) {
+            entries[i] = scan_sound_asset(paths[i]);
+        }
+        return entries;
+    }
+
+    // nothing here touches OpenAL, so unlike loading the workers don't need a context
+    std::atomic<size_t> next_file{0};
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker < num_threads; worker++) {
+        workers.emplace_back([&] {
+            for (size_t i = next_file++; i < paths.size(); i = next_file++) {
+                entries[i] = scan_sound_asset(paths[i]);
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    return entries;
+}
+
+AssetIndex::AssetIndex(std::vector<AssetIndexEntry> entries) : entries(std::move(entries)) {
+    for (size_t i = 0; i < this->entries.size(); i++) {
+        path_to_entry[this->entries[i].path] = i;
+    }
+}
+
+AssetIndex AssetIndex::read(const std::string &path) {
+    FileHandle file(fopen(path.c_str(), "rb"));
+    if (!file) {
+        fprintf(stderr, "Could not open asset index %s\n", path.c_str());
+        throw std::runtime_error("couldn't open the asset index");
+    }
+
+    std::string what = "the asset index " + path;
+    IndexHeader header;
+    read_array(file.get(), &header, 1, what);
+    if (std::memcmp(header.magic, index_magic, sizeof(index_magic)) != 0 || header.version != index_version) {
+        throw std::runtime_error(path + " isn't a version " + std::to_string(index_version) + " asset index");
+    }
+
+    std::vector<EntryRecord> records(header.num_entries);
+    std::string string_table(header.string_table_size, '\0');
+    read_array(file.get(), records.data(), records.size(), what);
+    read_array(file.get(), string_table.data(), string_table.size(), what);
+
+    std::vector<AssetIndexEntry> entries(records.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        const EntryRecord &record = records[i];
+        if ((uint64_t)record.path_offset + record.path_length > string_table.size()) {
+            throw std::runtime_error("a file path in " + path + " runs past the string table");
+        }
+        if (record.problem > (uint8_t)AssetProblem::too_large) {
+            throw std::runtime_error("entry " + std::to_string(i) + " in " + path + " has an unknown problem");
+        }
+
+        AssetIndexEntry &entry = entries[i];
+        entry.path = string_table.substr(record.path_offset, record.path_length);
+        entry.problem = (AssetProblem)record.problem;
+        entry.channels = record.channels;
+        entry.sample_rate = record.sample_rate;
+        entry.frames = record.frames;
+        entry.sndfile_format = record.sndfile_format;
+        entry.ambisonic_order = record.ambisonic_order;
+        entry.byte_block_alignment = record.byte_block_alignment;
+        entry.samples_per_block = record.samples_per_block;
+        entry.projected_bytes = record.projected_bytes;
+    }
+    return AssetIndex(std::move(entries));
+}
+
+void AssetIndex::write(const std::string &path) const {
+    std::vector<EntryRecord> records;
+    std::string string_table;
+    for (const AssetIndexEntry &entry : entries) {
+        EntryRecord record;
+        record.path_offset = (uint32_t)string_table.size();
+        record.path_length = (uint32_t)entry.path.size();
+        record.frames = entry.frames;
+        record.projected_bytes = entry.projected_bytes;
+        record.channels = entry.channels;
+        record.sample_rate = entry.sample_rate;
+        record.sndfile_format = entry.sndfile_format;
+        record.byte_block_alignment = entry.byte_block_alignment;
+        record.samples_per_block = entry.samples_per_block;
+        record.ambisonic_order = (uint8_t)entry.ambisonic_order;
+        record.problem = (uint8_t)entry.problem;
+        records.push_back(record);
+        string_table += entry.path;
+    }
+
+    IndexHeader header;
+    std::memcpy(header.magic, index_magic, sizeof(index_magic));
+    header.version = index_version;
+    header.num_entries = (uint32_t)records.size();
+    header.string_table_size = (uint32_t)string_table.size();
+
+    FileHandle file(fopen(path.c_str(), "wb"));
+    if (!file) {
+        throw std::runtime_error("couldn't open " + path + " for writing");
+    }
+    std::string what = "the asset index " + path;
+    write_array(file.get(), &header, 1, what);
+    write_array(file.get(), records.data(), records.size(), what);
+    write_array(file.get(), string_table.data(), string_table.size(), what);
+}
+
+const AssetIndexEntry *AssetIndex::find(const std::string &path) const {
+    auto it = path_to_entry.find(path);
+    return it == path_to_entry.end() ? nullptr : &entries[it->second];
+}
+
+const std::vector<AssetIndexEntry> &AssetIndex::get_entries() const { return entries; }
+
+void AssetIndex::validate(const std::vector<std::string> &paths) const {
+    bool higher_order_ambisonics = alIsExtensionPresent("AL_SOFT_bformat_hoa");
+    std::string problems;
+    for (const std::string &path : paths) {
+        const AssetIndexEntry *entry = find(path);
+        if (!entry) {
+            continue;
+        }
+        const char *problem = nullptr;
+        if (entry->problem != AssetProblem::none) {
+            problem = get_asset_problem_name(entry->problem);
+        } else if (entry->ambisonic_order > 1 && !higher_order_ambisonics) {
+            problem = "needs AL_SOFT_bformat_hoa";
+        }
+        if (problem) {
+            fprintf(stderr, "Asset %s %s\n", path.c_str(), problem);
+            problems += "\n  " + path + " " + problem;
+        }
+    }
+    if (!problems.empty()) {
+        throw std::runtime_error("sound assets failed validation:" + problems);
+    }
+}
+
+uint64_t AssetIndex::get_projected_bytes(const std::vector<std::string> &paths) const {
+    uint64_t bytes = 0;
+    for (const std::string &path : paths) {
+        if (const AssetIndexEntry *entry = find(path)) {
+            bytes += entry->projected_bytes;
+        }
+    }
+    return bytes;
+}
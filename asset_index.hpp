@@ -0,0 +1,72 @@
+#ifndef ASSET_INDEX_HPP
+#define ASSET_INDEX_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// why an asset can't be loaded, found without decoding any samples
+enum class AssetProblem : uint8_t {
+    none,
+    cant_open,
+    no_samples,
+    unsupported_channels, // no OpenAL format for the layout
+    too_large,            // more bytes than an OpenAL buffer can take
+};
+
+const char *get_asset_problem_name(AssetProblem problem);
+
+// what the header of a sound file says about it
+struct AssetIndexEntry {
+    std::string path;
+    AssetProblem problem = AssetProblem::none;
+    int channels = 0;
+    int sample_rate = 0;
+    int64_t frames = 0;
+    int sndfile_format = 0; // libsndfile's major and sub format
+    int ambisonic_order = 0;
+    // for ADPCM wavs which are loaded as is, 0 otherwise
+    int byte_block_alignment = 0;
+    int samples_per_block = 0;
+    // what the buffer will take up once loaded, assuming float samples are available
+    uint64_t projected_bytes = 0;
+};
+
+/**
+ * Opens every file and reads only its header, the files are spread over worker threads
+ * @param num_threads 0 uses every core
+ * @return an entry for every path, in the same order
+ */
+std::vector<AssetIndexEntry> scan_sound_assets(const std::vector<std::string> &paths, unsigned num_threads = 0);
+
+/**
+ * A scan written to disk, so it can be made when assets are built and checked against when the game starts. The file
+ * is a header, one fixed size record per asset and a string table of paths.
+ */
+class AssetIndex {
+  public:
+    AssetIndex() = default;
+    explicit AssetIndex(std::vector<AssetIndexEntry> entries);
+
+    static AssetIndex read(const std::string &path);
+    void write(const std::string &path) const;
+
+    // @return nullptr if the path wasn't scanned
+    const AssetIndexEntry *find(const std::string &path) const;
+    const std::vector<AssetIndexEntry> &get_entries() const;
+
+    /**
+     * Checks the files against the index before anything is decoded, files which weren't scanned are let through.
+     * Needs a current context to check for AL_SOFT_bformat_hoa.
+     * @throw std::runtime_error listing every file with a problem
+     */
+    void validate(const std::vector<std::string> &paths) const;
+    uint64_t get_projected_bytes(const std::vector<std::string> &paths) const;
+
+  private:
+    std::vector<AssetIndexEntry> entries;
+    std::unordered_map<std::string, size_t> path_to_entry;
+};
+
+#endif // ASSET_INDEX_HPP
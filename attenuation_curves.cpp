@@ -0,0 +1,142 @@
+#include "attenuation_curves.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ATTENUATION_CURVES_AVX2
+#endif
+
+/**
+ * Cubic hermite interpolation with the tangents picked as in PCHIP (Fritsch-Butland), a tangent is zero at a local
+ * extreme and otherwise a weighted harmonic mean of the neighbouring slopes, which keeps each piece monotone
+ */
+float AttenuationCurve::evaluate(float distance) const {
+    if (points.empty()) {
+        return 1.0f;
+    }
+    if (distance <= points.front().distance) {
+        return points.front().value;
+    }
+    if (distance >= points.back().distance) {
+        return points.back().value;
+    }
+
+    size_t segment = 0;
+    while (points[segment + 1].distance <= distance) {
+        segment++;
+    }
+
+    auto width = [&](size_t i) { return points[i + 1].distance - points[i].distance; };
+    auto slope = [&](size_t i) { return (points[i + 1].value - points[i].value) / width(i); };
+    auto tangent = [&](size_t i) {
+        if (i == 0) {
+            return slope(0);
+        }
+        if (i == points.size() - 1) {
+            return slope(i - 1);
+        }
+        float slope_before = slope(i - 1);
+        float slope_after = slope(i);
+        if (slope_before * slope_after <= 0) {
+            return 0.0f;
+        }
+        float width_before = width(i - 1);
+        float width_after = width(i);
+        return 3.0f * (width_before + width_after) /
+               ((2.0f * width_after + width_before) / slope_before + (width_after + 2.0f * width_before) / slope_after);
+    };
+
+    float h = width(segment);
+    float t = (distance - points[segment].distance) / h;
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return (2 * t3 - 3 * t2 + 1) * points[segment].value + (t3 - 2 * t2 + t) * h * tangent(segment) +
+           (-2 * t3 + 3 * t2) * points[segment + 1].value + (t3 - t2) * h * tangent(segment + 1);
+}
+
+AttenuationCurveId AttenuationTables::add(const AttenuationCurveSet &curves) {
+    const AttenuationCurve *set[] = {&curves.gain, &curves.low_pass, &curves.reverb_send};
+
+    float max_distance = 0;
+    for (const AttenuationCurve *curve : set) {
+        for (size_t i = 1; i < curve->points.size(); i++) {
+            assert(curve->points[i - 1].distance < curve->points[i].distance && "curve points must be sorted");
+        }
+        if (!curve->points.empty()) {
+            max_distance = std::max(max_distance, curve->points.back().distance);
+        }
+    }
+    if (max_distance <= 0) {
+        max_distance = 1.0f; // every curve is flat, any range will do
+    }
+    float scale = (float)(table_size - 1) / max_distance;
+
+    for (const AttenuationCurve *curve : set) {
+        for (int i = 0; i < table_size; i++) {
+            tables.push_back(curve->evaluate((float)i / scale));
+        }
+    }
+    distance_to_index.push_back(scale);
+    return (AttenuationCurveId)distance_to_index.size() - 1;
+}
+
+size_t AttenuationTables::size() const { return distance_to_index.size(); }
+
+AttenuationValues AttenuationTables::evaluate(AttenuationCurveId curve, float distance) const {
+    AttenuationValues values;
+    evaluate({&curve, 1}, {&distance, 1}, {&values.gain, 1}, {&values.low_pass, 1}, {&values.reverb_send, 1});
+    return values;
+}
+
+void AttenuationTables::evaluate(std::span<const AttenuationCurveId> curves, std::span<const float> distances,
+                                 std::span<float> gains, std::span<float> low_passes,
+                                 std::span<float> reverb_sends) const {
+    size_t count = curves.size();
+    assert(distances.size() == count && gains.size() == count && low_passes.size() == count &&
+           reverb_sends.size() == count);
+    float *outputs[] = {gains.data(), low_passes.data(), reverb_sends.data()};
+
+    size_t i = 0;
+#ifdef ATTENUATION_CURVES_AVX2
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 last_index = _mm256_set1_ps((float)(table_size - 1));
+    const __m256i last_index_int = _mm256_set1_epi32(table_size - 1);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i set_stride = _mm256_set1_epi32(3 * table_size);
+    for (; i + 8 <= count; i += 8) {
+        __m256i ids = _mm256_loadu_si256((const __m256i *)(curves.data() + i));
+        __m256 scale = _mm256_i32gather_ps(distance_to_index.data(), ids, 4);
+        __m256 position = _mm256_mul_ps(_mm256_loadu_ps(distances.data() + i), scale);
+        position = _mm256_min_ps(_mm256_max_ps(position, zero), last_index);
+
+        __m256i index = _mm256_cvttps_epi32(position);
+        __m256 fraction = _mm256_sub_ps(position, _mm256_cvtepi32_ps(index));
+        __m256i next_index = _mm256_min_epi32(_mm256_add_epi32(index, one), last_index_int);
+        __m256i set_start = _mm256_mullo_epi32(ids, set_stride);
+        index = _mm256_add_epi32(index, set_start);
+        next_index = _mm256_add_epi32(next_index, set_start);
+
+        for (int table = 0; table < 3; table++) {
+            const float *values = tables.data() + table * table_size;
+            __m256 current = _mm256_i32gather_ps(values, index, 4);
+            __m256 next = _mm256_i32gather_ps(values, next_index, 4);
+            __m256 value = _mm256_add_ps(current, _mm256_mul_ps(_mm256_sub_ps(next, current), fraction));
+            _mm256_storeu_ps(outputs[table] + i, value);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        assert(curves[i] < distance_to_index.size());
+        float position = std::clamp(distances[i] * distance_to_index[curves[i]], 0.0f, (float)(table_size - 1));
+        int index = (int)position;
+        float fraction = position - (float)index;
+        int next_index = std::min(index + 1, table_size - 1);
+        const float *set = tables.data() + (size_t)curves[i] * 3 * table_size;
+        for (int table = 0; table < 3; table++) {
+            const float *values = set + table * table_size;
+            outputs[table][i] = values[index] + (values[next_index] - values[index]) * fraction;
+        }
+    }
+}
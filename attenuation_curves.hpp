@@ -0,0 +1,65 @@
+#ifndef ATTENUATION_CURVES_HPP
+#define ATTENUATION_CURVES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+using AttenuationCurveId = uint32_t;
+constexpr AttenuationCurveId no_attenuation_curve = UINT32_MAX;
+
+struct CurvePoint {
+    float distance;
+    float value;
+};
+
+/**
+ * A value against distance, the points are joined by a monotone cubic spline so the curve never overshoots the
+ * authored values. Before the first point and after the last the curve stays flat, with no points it's 1 everywhere.
+ */
+struct AttenuationCurve {
+    std::vector<CurvePoint> points;
+
+    float evaluate(float distance) const;
+};
+
+// what a designer authors for an event, every curve goes from 1 (untouched) down to 0
+struct AttenuationCurveSet {
+    AttenuationCurve gain;
+    AttenuationCurve low_pass; // the high frequency gain of the direct path
+    AttenuationCurve reverb_send;
+};
+
+struct AttenuationValues {
+    float gain = 1.0f;
+    float low_pass = 1.0f;
+    float reverb_send = 1.0f;
+};
+
+/**
+ * The curve sets baked into fixed size lookup tables which are linearly interpolated, evaluating a voice is a handful
+ * of loads no matter how many points the curves have. With AVX2 eight voices are looked up at once with gathers.
+ */
+class AttenuationTables {
+  public:
+    static constexpr int table_size = 256;
+
+    // the tables cover the distances up to the furthest point of the set's curves
+    AttenuationCurveId add(const AttenuationCurveSet &curves);
+    size_t size() const;
+
+    AttenuationValues evaluate(AttenuationCurveId curve, float distance) const;
+    /**
+     * Evaluates every voice at once, each output span is written at the same index as its input
+     */
+    void evaluate(std::span<const AttenuationCurveId> curves, std::span<const float> distances, std::span<float> gains,
+                  std::span<float> low_passes, std::span<float> reverb_sends) const;
+
+  private:
+    // each set has three tables back to back, gain then low pass then reverb send
+    std::vector<float> tables;
+    std::vector<float> distance_to_index; // per set
+};
+
+#endif // ATTENUATION_CURVES_HPP
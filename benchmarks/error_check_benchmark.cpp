@@ -0,0 +1,101 @@
+/**
+ * Times the calls that read OpenAL's error state in checked mode, set_source_gain, set_listener_position,
+ * set_source_looping_option and play_sound, with each ErrorCheckMode and reports the cost per call. It runs on a
+ * loopback device so the only thing that changes between the modes is how often the error state is read. Build from
+ * the repository root with something like
+ *
+ *   g++ -std=c++20 -O2 -msse2 -I. -Ibenchmarks benchmarks/error_check_benchmark.cpp *.cpp -lopenal -lsndfile -pthread
+ *
+ * and run it with any sound file, eg `error_check_benchmark footstep.wav`.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "sound_system.hpp"
+
+namespace {
+
+constexpr int calls_per_frame = 100;
+constexpr int num_frames = 200;
+
+struct TimedCall {
+    const char *name;
+    std::function<void(SoundSystem &, int)> call;
+};
+
+/**
+ * Only the calls are timed, play_all_sounds runs between batches as a game's frame would and is timed on its own since
+ * that's where deferred mode does its one check
+ * @return the mean nanoseconds per call, then per play_all_sounds
+ */
+std::pair<double, double> time_call(const char *file, ErrorCheckMode mode, const TimedCall &timed_call) {
+    LoopbackFormat format;
+    SoundSystem sound_system(format);
+    sound_system.load_sound_into_system_for_playback("sound", file);
+    sound_system.create_sound_source("source");
+    sound_system.play_sound("source", "sound");
+    sound_system.set_error_check_mode(mode);
+
+    using clock = std::chrono::steady_clock;
+    double call_seconds = 0.0;
+    double frame_seconds = 0.0;
+    std::vector<float> scratch((size_t)calls_per_frame * format.channels);
+    for (int frame = 0; frame < num_frames; frame++) {
+        clock::time_point start = clock::now();
+        for (int i = 0; i < calls_per_frame; i++) {
+            timed_call.call(sound_system, i);
+        }
+        clock::time_point frame_start = clock::now();
+        sound_system.play_all_sounds();
+        clock::time_point frame_end = clock::now();
+        call_seconds += std::chrono::duration<double>(frame_start - start).count();
+        frame_seconds += std::chrono::duration<double>(frame_end - frame_start).count();
+        sound_system.render_loopback(scratch.data(), calls_per_frame);
+    }
+    return {call_seconds * 1e9 / ((double)num_frames * calls_per_frame), frame_seconds * 1e9 / num_frames};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <sound file>\n", argv[0]);
+        return 1;
+    }
+    const std::pair<ErrorCheckMode, const char *> modes[] = {
+        {ErrorCheckMode::checked, "checked"},
+        {ErrorCheckMode::deferred, "deferred"},
+        {ErrorCheckMode::off, "off"},
+    };
+    // every call changes something, the listener moves further than the epsilon so it isn't skipped
+    const TimedCall calls[] = {
+        {"set_source_gain", [](SoundSystem &sound_system, int i) {
+             sound_system.set_source_gain("source", i % 2 ? 0.5f : 0.75f);
+         }},
+        {"set_listener_position", [](SoundSystem &sound_system, int i) {
+             sound_system.set_listener_position((float)(i % 2), 0.0f, 0.0f);
+         }},
+        {"set_source_looping_option", [](SoundSystem &sound_system, int i) {
+             sound_system.set_source_looping_option("source", i % 2 == 0);
+         }},
+        {"play_sound", [](SoundSystem &sound_system, int) { sound_system.play_sound("source", "sound"); }},
+    };
+
+    printf("%-28s  %-10s  %12s  %22s\n", "call", "mode", "ns per call", "ns per play_all_sounds");
+    try {
+        for (const TimedCall &timed_call : calls) {
+            for (const auto &[mode, name] : modes) {
+                auto [call_ns, frame_ns] = time_call(argv[1], mode, timed_call);
+                printf("%-28s  %-10s  %12.1f  %22.1f\n", timed_call.name, name, call_ns, frame_ns);
+            }
+        }
+    } catch (const std::runtime_error &error) {
+        fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
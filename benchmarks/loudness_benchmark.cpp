@@ -0,0 +1,107 @@
+/**
+ * Compares what measuring loudness costs the loader against decoding the same files, metering should stay under a
+ * tenth of the decode. Files are decoded as the loader decodes them, 16 bit unless the source is float, and metered
+ * from memory so the two times don't overlap. Uncompressed wavs decode at close to the speed of a copy, so the budget
+ * is for compressed files like Vorbis, FLAC and Opus. Build from the repository root with something like
+ *
+ *   g++ -std=c++20 -O2 -msse2 -I. benchmarks/loudness_benchmark.cpp loudness.cpp load_sound_file.cpp
+ *       openal_extensions.cpp -lopenal -lsndfile -pthread
+ *
+ * and run it with a few representative files, eg `loudness_benchmark music.ogg footstep.wav dialogue.flac`.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <sndfile.h>
+#include <vector>
+
+#include "load_sound_file.hpp"
+#include "loudness.hpp"
+
+namespace {
+
+// the best of a few runs so a cold cache or a context switch doesn't decide the result
+constexpr int num_runs = 5;
+
+struct DecodedFile {
+    SF_INFO info{};
+    bool is_float = false;
+    std::vector<short> shorts;
+    std::vector<float> floats;
+};
+
+bool decode_file(const char *filename, DecodedFile &decoded) {
+    SNDFILE *sound_file = sf_open(filename, SFM_READ, &decoded.info);
+    if (!sound_file) {
+        fprintf(stderr, "Could not open %s: %s\n", filename, sf_strerror(NULL));
+        return false;
+    }
+    decoded.is_float = is_float_source_format(decoded.info.format);
+    size_t num_samples = (size_t)decoded.info.frames * decoded.info.channels;
+    sf_count_t num_frames;
+    if (decoded.is_float) {
+        decoded.floats.resize(num_samples);
+        num_frames = sf_readf_float(sound_file, decoded.floats.data(), decoded.info.frames);
+    } else {
+        decoded.shorts.resize(num_samples);
+        num_frames = sf_readf_short(sound_file, decoded.shorts.data(), decoded.info.frames);
+    }
+    sf_close(sound_file);
+    decoded.info.frames = std::max<sf_count_t>(num_frames, 0);
+    return true;
+}
+
+float measure_loudness(const DecodedFile &decoded) {
+    LoudnessMeter meter(decoded.info.channels, decoded.info.samplerate);
+    if (decoded.is_float) {
+        meter.add_frames(decoded.floats.data(), (size_t)decoded.info.frames);
+    } else {
+        meter.add_frames(decoded.shorts.data(), (size_t)decoded.info.frames);
+    }
+    // the envelope is built alongside the integrated loudness on every load
+    meter.get_loudness_envelope();
+    return meter.get_integrated_loudness();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <sound file>...\n", argv[0]);
+        return 1;
+    }
+    using clock = std::chrono::steady_clock;
+    double total_decode_seconds = 0.0;
+    double total_meter_seconds = 0.0;
+
+    printf("%-40s  %10s  %12s  %12s  %8s\n", "file", "LUFS", "decode ms", "meter ms", "meter %");
+    for (int i = 1; i < argc; i++) {
+        double decode_seconds = std::numeric_limits<double>::max();
+        double meter_seconds = std::numeric_limits<double>::max();
+        float loudness = unmeasured_loudness;
+        for (int run = 0; run < num_runs; run++) {
+            DecodedFile decoded;
+            clock::time_point decode_start = clock::now();
+            if (!decode_file(argv[i], decoded)) {
+                return 1;
+            }
+            clock::time_point meter_start = clock::now();
+            loudness = measure_loudness(decoded);
+            clock::time_point meter_end = clock::now();
+            using seconds = std::chrono::duration<double>;
+            decode_seconds = std::min(decode_seconds, seconds(meter_start - decode_start).count());
+            meter_seconds = std::min(meter_seconds, seconds(meter_end - meter_start).count());
+        }
+        total_decode_seconds += decode_seconds;
+        total_meter_seconds += meter_seconds;
+        printf("%-40s  %10.1f  %12.3f  %12.3f  %7.1f%%\n", argv[i], loudness, decode_seconds * 1000.0,
+               meter_seconds * 1000.0, meter_seconds * 100.0 / decode_seconds);
+    }
+
+    double percentage = total_meter_seconds * 100.0 / total_decode_seconds;
+    printf("metering took %.1f%% of the decode time over every file, %s the 10%% budget\n", percentage,
+           percentage < 10.0 ? "within" : "over");
+    return percentage < 10.0 ? 0 : 2;
+}
@@ -0,0 +1,9 @@
+#ifndef SBPT_GENERATED_INCLUDES_HPP
+#define SBPT_GENERATED_INCLUDES_HPP
+
+// stands in for the one sbpt generates so the benchmarks build on their own, they only play the first sound type
+enum class SoundType {
+    BENCHMARK_SOUND,
+};
+
+#endif // SBPT_GENERATED_INCLUDES_HPP
@@ -0,0 +1,118 @@
+/**
+ * Times the same number of voices played with a source each against the software mixer, on a loopback device so
+ * nothing waits on an audio device and the cost is all mixing. Build from the repository root with something like
+ *
+ *   g++ -std=c++20 -O2 -msse2 -I. -Ibenchmarks benchmarks/software_mixer_benchmark.cpp *.cpp -lopenal -lsndfile
+ *       -pthread
+ *
+ * and run it with a mono file at least as long as the render, eg `software_mixer_benchmark rain.wav 4`. benchmarks/
+ * has a stand in for the sbpt generated include with a SoundType of its own, when sbpt has been run the generated one
+ * next to sound_system.hpp is used instead.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unistd.h>
+#include <vector>
+
+#include "sound_system.hpp"
+
+namespace {
+
+constexpr int voice_counts[] = {64, 512, 4096};
+// about a frame at 90fps, play_all_sounds is called between chunks as a game would
+constexpr int chunk_frames = 512;
+
+struct BenchmarkResult {
+    size_t voices_at_start = 0;
+    size_t voices_at_end = 0;
+    double wall_seconds = 0.0;
+};
+
+// removes the OpenAL Soft config the benchmark writes once it's done, however it exits
+struct TemporaryFile {
+    std::filesystem::path path;
+    ~TemporaryFile() {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+};
+
+BenchmarkResult run_benchmark(const std::string &file, int num_voices, bool software_mixer, double seconds) {
+    std::unordered_map<SoundType, SoundVariations> sound_type_to_variations = {
+        {static_cast<SoundType>(0), {{file}}},
+    };
+    LoopbackFormat format;
+    // a pooled source per voice, the mixer only needs its stream's source
+    SoundSystem sound_system(software_mixer ? 1 : num_voices, sound_type_to_variations, nullptr, {}, &format);
+    sound_system.seed_random(1);
+    if (software_mixer) {
+        sound_system.enable_software_mixer();
+    }
+
+    // spread over a disc around the listener so every voice is audible and none are culled
+    for (int i = 0; i < num_voices; i++) {
+        float angle = i * 2.399963f; // the golden angle
+        float radius = 1.0f + 19.0f * std::sqrt((i + 0.5f) / num_voices);
+        sound_system.queue_sound(static_cast<SoundType>(0),
+                                 {radius * std::cos(angle), 0.0f, radius * std::sin(angle)});
+    }
+    sound_system.play_all_sounds();
+    std::vector<float> scratch((size_t)chunk_frames * format.channels);
+    // the mixer's voices are picked up by its first block
+    sound_system.render_loopback(scratch.data(), chunk_frames);
+
+    BenchmarkResult result;
+    result.voices_at_start = sound_system.get_active_voice_count();
+    using clock = std::chrono::steady_clock;
+    clock::time_point start = clock::now();
+    int64_t num_frames = (int64_t)(seconds * format.sample_rate);
+    for (int64_t rendered = 0; rendered < num_frames; rendered += chunk_frames) {
+        sound_system.play_all_sounds();
+        sound_system.render_loopback(scratch.data(), chunk_frames);
+    }
+    result.wall_seconds = std::chrono::duration<double>(clock::now() - start).count();
+    result.voices_at_end = sound_system.get_active_voice_count();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <mono sound file> [seconds to render, default 2]\n", argv[0]);
+        return 1;
+    }
+    std::string file = argv[1];
+    double seconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+
+    // OpenAL Soft only hands out 256 sources unless it's configured for more
+    TemporaryFile config{std::filesystem::temp_directory_path() /
+                         ("software_mixer_benchmark_" + std::to_string(getpid()) + ".conf")};
+    std::ofstream(config.path) << "[general]\nsources = 8192\n";
+    setenv("ALSOFT_CONF", config.path.c_str(), 1);
+
+    printf("%8s  %-8s  %14s  %14s  %12s  %10s\n", "voices", "path", "voices playing", "at the end", "ms per sec",
+           "realtime");
+    try {
+        for (int num_voices : voice_counts) {
+            for (bool software_mixer : {false, true}) {
+                BenchmarkResult result = run_benchmark(file, num_voices, software_mixer, seconds);
+                printf("%8d  %-8s  %14zu  %14zu  %12.2f  %9.1fx\n", num_voices, software_mixer ? "mixer" : "sources",
+                       result.voices_at_start, result.voices_at_end, result.wall_seconds * 1000.0 / seconds,
+                       seconds / result.wall_seconds);
+            }
+        }
+    } catch (const std::runtime_error &error) {
+        fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
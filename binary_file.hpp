@@ -0,0 +1,29 @@
+#ifndef BINARY_FILE_HPP
+#define BINARY_FILE_HPP
+
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// helpers for the tables which are written to disk as arrays of fixed size records
+
+struct FileCloser {
+    void operator()(FILE *file) const { fclose(file); }
+};
+using FileHandle = std::unique_ptr<FILE, FileCloser>;
+
+// @param what names the file in the error, eg "the sound event table foo.sevt"
+template <typename T> void write_array(FILE *file, const T *data, size_t count, const std::string &what) {
+    if (count > 0 && fwrite(data, sizeof(T), count, file) != count) {
+        throw std::runtime_error("failed to write " + what);
+    }
+}
+
+template <typename T> void read_array(FILE *file, T *data, size_t count, const std::string &what) {
+    if (count > 0 && fread(data, sizeof(T), count, file) != count) {
+        throw std::runtime_error(what + " is truncated");
+    }
+}
+
+#endif // BINARY_FILE_HPP
@@ -0,0 +1,39 @@
+#include "bus_ducking.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+void BusDucker::add_rule(const DuckingRule &rule) {
+    assert(rule.sidechain != rule.target && rule.threshold > 0 && rule.ratio >= 1);
+    rules.push_back(rule);
+    envelopes.push_back(0.0f);
+}
+
+bool BusDucker::has_rules() const { return !rules.empty(); }
+
+void BusDucker::update(const std::vector<float> &bus_loudness, float delta_time, BusGraph &bus_graph) {
+    target_duck_gains.assign(bus_graph.get_bus_count(), 1.0f);
+
+    for (size_t i = 0; i < rules.size(); i++) {
+        const DuckingRule &rule = rules[i];
+        float loudness = rule.sidechain < bus_loudness.size() ? bus_loudness[rule.sidechain] : 0.0f;
+
+        // one pole follower, rising with the attack time and falling with the release time
+        float &envelope = envelopes[i];
+        float time_constant = loudness > envelope ? rule.attack_seconds : rule.release_seconds;
+        float coefficient = time_constant > 0 ? 1.0f - std::exp(-delta_time / time_constant) : 1.0f;
+        envelope += (loudness - envelope) * coefficient;
+
+        if (envelope <= rule.threshold) {
+            continue;
+        }
+        float over_db = 20.0f * std::log10(envelope / rule.threshold);
+        float reduction_db = std::min(over_db * (1.0f - 1.0f / rule.ratio), rule.max_reduction_db);
+        target_duck_gains[rule.target] *= std::pow(10.0f, -reduction_db / 20.0f);
+    }
+
+    for (BusId bus = 0; bus < target_duck_gains.size(); bus++) {
+        bus_graph.set_duck_gain(bus, target_duck_gains[bus]);
+    }
+}
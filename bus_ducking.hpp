@@ -0,0 +1,40 @@
+#ifndef BUS_DUCKING_HPP
+#define BUS_DUCKING_HPP
+
+#include <vector>
+
+#include "mixer_bus.hpp"
+
+/**
+ * Turns a bus down while another bus is loud, eg music and sfx while dialogue plays. The sidechain bus's loudness is
+ * smoothed by an envelope follower and anything above the threshold is compressed by the ratio, the resulting gain
+ * reduction is applied to the target bus.
+ */
+struct DuckingRule {
+    BusId sidechain;
+    BusId target;
+    float threshold = 0.05f; // linear loudness of the sidechain where ducking starts
+    float ratio = 4.0f;
+    float max_reduction_db = 12.0f;
+    float attack_seconds = 0.05f;
+    float release_seconds = 0.5f;
+};
+
+class BusDucker {
+  public:
+    void add_rule(const DuckingRule &rule);
+    bool has_rules() const;
+
+    /**
+     * Advances every envelope and hands the resulting duck gains to the graph, meant to be called once per tick
+     * @param bus_loudness the estimated loudness of each bus including the buses below it, indexed by bus id
+     */
+    void update(const std::vector<float> &bus_loudness, float delta_time, BusGraph &bus_graph);
+
+  private:
+    std::vector<DuckingRule> rules;
+    std::vector<float> envelopes;
+    std::vector<float> target_duck_gains; // scratch, indexed by bus id
+};
+
+#endif // BUS_DUCKING_HPP
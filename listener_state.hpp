@@ -0,0 +1,46 @@
+#ifndef LISTENER_STATE_HPP
+#define LISTENER_STATE_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <glm/glm.hpp>
+
+// Where the listener is and which way it's facing, forward and up should be unit length
+struct ListenerState {
+    glm::vec3 position{0.0f, 0.0f, 0.0f};
+    glm::vec3 forward{0.0f, 0.0f, -1.0f};
+    glm::vec3 up{0.0f, 1.0f, 0.0f};
+    glm::vec3 velocity{0.0f, 0.0f, 0.0f};
+};
+
+// @return the index of the listener closest to the position, 0 if there are none
+inline size_t find_nearest_listener(std::span<const ListenerState> listeners, glm::vec3 position) {
+    size_t nearest = 0;
+    float nearest_distance_squared = INFINITY;
+    for (size_t i = 0; i < listeners.size(); i++) {
+        glm::vec3 to_listener = listeners[i].position - position;
+        float distance_squared = glm::dot(to_listener, to_listener);
+        if (distance_squared < nearest_distance_squared) {
+            nearest = i;
+            nearest_distance_squared = distance_squared;
+        }
+    }
+    return nearest;
+}
+
+// rotates a direction into OpenAL's default listener space, where x is right, y is up and -z is forward
+inline glm::vec3 rotate_into_listener_space(const ListenerState &listener, glm::vec3 direction) {
+    glm::vec3 right = glm::cross(listener.forward, listener.up);
+    float length = std::sqrt(glm::dot(right, right));
+    right = length > 0 ? right / length : glm::vec3(1, 0, 0);
+    glm::vec3 up = glm::cross(right, listener.forward);
+    return {glm::dot(direction, right), glm::dot(direction, up), -glm::dot(direction, listener.forward)};
+}
+
+// where the position is relative to the listener, so it sounds the same to a listener at the origin facing -z
+inline glm::vec3 to_listener_space(const ListenerState &listener, glm::vec3 position) {
+    return rotate_into_listener_space(listener, position - listener.position);
+}
+
+#endif // LISTENER_STATE_HPP
@@ -3,16 +3,24 @@
 #include <AL/alext.h>
 #include <sndfile.h>
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cinttypes>
 #include <climits>
+#include <cmath>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <exception>
 #include <map>
 #include <stdexcept>
+#include <thread>
+#include <type_traits>
 
 #include <string>
 #include <sstream>
+#include <vector>
 
 // NOTE:: this is required by https://stackoverflow.com/questions/12975341/to-string-is-not-a-member-of-std-says-g-mingw
 namespace patch {
@@ -25,6 +33,11 @@ template <typename T> std::string to_string(const T &n) {
 
 #include <iostream>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LOAD_SOUND_FILE_SSE
+#endif
+
 std::map<ALenum, const char *> openal_format_enum_to_string = {
     {AL_FORMAT_MONO8, "Mono, U8"},
     {AL_FORMAT_MONO16, "Mono, S16"},
@@ -179,31 +192,27 @@ const char *FormatName(ALenum format) {
 }
 
 /* Open the audio file and check that it's usable. */
-void open_audio_file(const char *filename, SNDFILE **sound_file, SF_INFO *sound_file_info_ptr) {
-    // dereference the pointer, and store a pointer there
-    *sound_file = sf_open(filename, SFM_READ, sound_file_info_ptr);
-    bool success = true;
-    if (!*sound_file) {
-        fprintf(stderr, "Could not open audio in %s: %s\n", filename, sf_strerror(*sound_file));
-        success = false;
-    }
-    if (sound_file_info_ptr->frames < 1) {
-        fprintf(stderr, "Bad sample count in %s (%" PRId64 ")\n", filename, sound_file_info_ptr->frames);
-        sf_close(*sound_file);
-        success = false;
+LoadError open_audio_file(const char *filename, SoundFileHandle &sound_file, SF_INFO &sound_file_info, int &detail) {
+    sound_file_info = {};
+    sound_file.reset(sf_open(filename, SFM_READ, &sound_file_info));
+    if (!sound_file) {
+        // libsndfile keeps the error of a failed open in a global shared by every thread, it's read straight away but
+        // a load failing on another thread at the same moment can still overwrite it
+        detail = sf_error(NULL);
+        return LoadError::cant_open;
     }
-    if (not success) {
-        throw std::runtime_error("couldn't open audio or bad sample count");
+    if (sound_file_info.frames < 1) {
+        return LoadError::no_samples;
     }
+    return LoadError::none;
 }
 
 /* Detect a suitable format to load. Formats like Vorbis and Opus use float
  * natively, so load as float to avoid clipping when possible. Formats
  * larger than 16-bit can also use float to preserve a bit more precision.
  */
-enum FormatType determine_format_type(SF_INFO sound_file_info) {
-    enum FormatType sample_format = Int16;
-    switch ((sound_file_info.format & SF_FORMAT_SUBMASK)) {
+bool is_float_source_format(int sndfile_format) {
+    switch ((sndfile_format & SF_FORMAT_SUBMASK)) {
     case SF_FORMAT_PCM_24:
     case SF_FORMAT_PCM_32:
     case SF_FORMAT_FLOAT:
@@ -216,9 +225,19 @@ enum FormatType determine_format_type(SF_INFO sound_file_info) {
     case 0x0080 /*SF_FORMAT_MPEG_LAYER_I*/:
     case 0x0081 /*SF_FORMAT_MPEG_LAYER_II*/:
     case 0x0082 /*SF_FORMAT_MPEG_LAYER_III*/:
+        return true;
+    }
+    return false;
+}
+
+enum FormatType determine_format_type(SF_INFO sound_file_info) {
+    enum FormatType sample_format = Int16;
+    if (is_float_source_format(sound_file_info.format)) {
         if (alIsExtensionPresent("AL_EXT_FLOAT32"))
             sample_format = Float;
-        break;
+        return sample_format;
+    }
+    switch ((sound_file_info.format & SF_FORMAT_SUBMASK)) {
     case SF_FORMAT_IMA_ADPCM:
         /* ADPCM formats require setting a block alignment as specified in the
          * file, which needs to be read from the wave 'fmt ' chunk manually
@@ -237,46 +256,47 @@ enum FormatType determine_format_type(SF_INFO sound_file_info) {
     return sample_format;
 }
 
-std::tuple<ALint, ALint> get_byte_and_samples_per_block_alignment(enum FormatType sample_format, const char *filename,
-                                                                  SNDFILE *sound_file, SF_INFO sound_file_info) {
-    ALint byteblockalign = 0;
-    ALint splblockalign = 0;
-    if (sample_format == IMA4 || sample_format == MSADPCM) {
-        /* For ADPCM, lookup the wave file's "fmt " chunk, which is a
-         * WAVEFORMATEX-based structure for the audio format.
-         */
-        SF_CHUNK_INFO inf = {"fmt ", 4, 0, NULL};
-        SF_CHUNK_ITERATOR *iter = sf_get_chunk_iterator(sound_file, &inf);
+bool read_adpcm_block_alignment(SNDFILE *sound_file, int channels, bool ima4, ALint &byteblockalign,
+                                ALint &splblockalign) {
+    /* For ADPCM, lookup the wave file's "fmt " chunk, which is a
+     * WAVEFORMATEX-based structure for the audio format.
+     */
+    SF_CHUNK_INFO inf = {"fmt ", 4, 0, NULL};
+    SF_CHUNK_ITERATOR *iter = sf_get_chunk_iterator(sound_file, &inf);
+    if (!iter || sf_get_chunk_size(iter, &inf) != SF_ERR_NO_ERROR || inf.datalen < 14)
+        return false;
 
-        /* If there's an issue getting the chunk or block alignment, load as
-         * 16-bit and have libsndfile do the conversion.
+    bool valid = false;
+    std::vector<ALubyte> fmtbuf(inf.datalen);
+    inf.data = fmtbuf.data();
+    if (sf_get_chunk_data(iter, &inf) == SF_ERR_NO_ERROR) {
+        /* Read the nBlockAlign field, and convert from bytes- to
+         * samples-per-block (verifying it's valid by converting back
+         * and comparing to the original value).
          */
-        if (!iter || sf_get_chunk_size(iter, &inf) != SF_ERR_NO_ERROR || inf.datalen < 14)
-            sample_format = Int16;
-        else {
-            ALubyte *fmtbuf = (ALubyte *)calloc(inf.datalen, 1);
-            inf.data = fmtbuf;
-            if (sf_get_chunk_data(iter, &inf) != SF_ERR_NO_ERROR)
-                sample_format = Int16;
-            else {
-                /* Read the nBlockAlign field, and convert from bytes- to
-                 * samples-per-block (verifying it's valid by converting back
-                 * and comparing to the original value).
-                 */
-                byteblockalign = fmtbuf[12] | (fmtbuf[13] << 8);
-                if (sample_format == IMA4) {
-                    splblockalign = (byteblockalign / sound_file_info.channels - 4) / 4 * 8 + 1;
-                    if (splblockalign < 1 || ((splblockalign - 1) / 2 + 4) * sound_file_info.channels != byteblockalign)
-                        sample_format = Int16;
-                } else {
-                    splblockalign = (byteblockalign / sound_file_info.channels - 7) * 2 + 2;
-                    if (splblockalign < 2 || ((splblockalign - 2) / 2 + 7) * sound_file_info.channels != byteblockalign)
-                        sample_format = Int16;
-                }
-            }
-            free(fmtbuf);
+        byteblockalign = fmtbuf[12] | (fmtbuf[13] << 8);
+        if (ima4) {
+            splblockalign = (byteblockalign / channels - 4) / 4 * 8 + 1;
+            valid = splblockalign >= 1 && ((splblockalign - 1) / 2 + 4) * channels == byteblockalign;
+        } else {
+            splblockalign = (byteblockalign / channels - 7) * 2 + 2;
+            valid = splblockalign >= 2 && ((splblockalign - 2) / 2 + 7) * channels == byteblockalign;
         }
     }
+    return valid;
+}
+
+LoadError get_byte_and_samples_per_block_alignment(enum FormatType &sample_format, SNDFILE *sound_file,
+                                                   const SF_INFO &sound_file_info, ALint &byteblockalign,
+                                                   ALint &splblockalign) {
+    /* If there's an issue getting the chunk or block alignment, load as
+     * 16-bit and have libsndfile do the conversion.
+     */
+    if ((sample_format == IMA4 || sample_format == MSADPCM) &&
+        !read_adpcm_block_alignment(sound_file, sound_file_info.channels, sample_format == IMA4, byteblockalign,
+                                    splblockalign)) {
+        sample_format = Int16;
+    }
 
     if (sample_format == Int16) {
         splblockalign = 1;
@@ -287,16 +307,208 @@ std::tuple<ALint, ALint> get_byte_and_samples_per_block_alignment(enum FormatTyp
     }
 
     if (sound_file_info.frames / splblockalign > (sf_count_t)(INT_MAX / byteblockalign)) {
-        fprintf(stderr, "Too many samples in %s (%" PRId64 ")\n", filename, sound_file_info.frames);
-        sf_close(sound_file);
-        throw std::runtime_error("too many samples");
+        return LoadError::too_many_samples;
+    }
+    return LoadError::none;
+}
+
+ALint get_ambisonic_order(int channels, bool &three_dimensional) {
+    three_dimensional = false;
+    for (ALint order = 1; order <= 3; order++) {
+        if (channels == (order + 1) * (order + 1)) {
+            three_dimensional = true;
+            return order;
+        }
+        if (channels == 2 * order + 1) {
+            return order;
+        }
     }
+    return 0;
+}
 
-    return {byteblockalign, splblockalign};
+ALenum get_multichannel_openal_format(int channels, bool ambisonic, bool float_samples, ALint &ambisonic_order) {
+    ambisonic_order = 0;
+    if (ambisonic) {
+        bool three_dimensional;
+        ambisonic_order = get_ambisonic_order(channels, three_dimensional);
+        if (ambisonic_order == 0 || (ambisonic_order > 1 && !alIsExtensionPresent("AL_SOFT_bformat_hoa"))) {
+            return AL_NONE;
+        }
+        if (three_dimensional) {
+            return float_samples ? AL_FORMAT_BFORMAT3D_FLOAT32 : AL_FORMAT_BFORMAT3D_16;
+        }
+        return float_samples ? AL_FORMAT_BFORMAT2D_FLOAT32 : AL_FORMAT_BFORMAT2D_16;
+    }
+
+    switch (channels) {
+    case 4:
+        return float_samples ? AL_FORMAT_QUAD32 : AL_FORMAT_QUAD16;
+    case 6:
+        return float_samples ? AL_FORMAT_51CHN32 : AL_FORMAT_51CHN16;
+    case 7:
+        return float_samples ? AL_FORMAT_61CHN32 : AL_FORMAT_61CHN16;
+    case 8:
+        return float_samples ? AL_FORMAT_71CHN32 : AL_FORMAT_71CHN16;
+    }
+    return AL_NONE;
 }
 
-/* Figure out the OpenAL format from the file and desired sample type. */
-ALenum determine_openal_format(SNDFILE *sound_file, SF_INFO sound_file_info, enum FormatType sample_format) {
+const char *get_load_error_name(LoadError error) {
+    switch (error) {
+    case LoadError::none:
+        return "no error";
+    case LoadError::cant_open:
+        return "couldn't open audio";
+    case LoadError::no_samples:
+        return "bad sample count";
+    case LoadError::too_many_samples:
+        return "too many samples";
+    case LoadError::unsupported_channels:
+        return "unsupported channel count";
+    case LoadError::out_of_memory:
+        return "out of memory";
+    case LoadError::read_failed:
+        return "failed to read samples";
+    case LoadError::openal_error:
+        return "openal error";
+    }
+    return "unknown error";
+}
+
+const char *get_load_stage_name(LoadStage stage) {
+    switch (stage) {
+    case LoadStage::open:
+        return "open";
+    case LoadStage::format:
+        return "format";
+    case LoadStage::decode:
+        return "decode";
+    case LoadStage::upload:
+        return "upload";
+    }
+    return "unknown";
+}
+
+namespace {
+
+void print_load_failure(const char *filename, const LoadResult &result) {
+    fprintf(stderr, "Failed to load %s at the %s stage: %s", filename, get_load_stage_name(result.stage),
+            get_load_error_name(result.error));
+    if (result.error == LoadError::cant_open) {
+        fprintf(stderr, " (%s)", sf_error_number(result.detail));
+    } else if (result.error == LoadError::openal_error) {
+        fprintf(stderr, " (%s)", alGetString(result.detail));
+    } else if (result.error == LoadError::unsupported_channels) {
+        fprintf(stderr, " (%d)", result.detail);
+    }
+    fprintf(stderr, "\n");
+}
+
+[[noreturn]] void throw_load_failure(const char *filename, const LoadResult &result) {
+    print_load_failure(filename, result);
+    throw std::runtime_error(get_load_error_name(result.error));
+}
+
+template <typename T> bool is_loud(T sample, T threshold) { return sample > threshold || sample < -threshold; }
+
+#ifdef LOAD_SOUND_FILE_SSE
+template <typename T> constexpr size_t samples_per_vector = 16 / sizeof(T);
+template <typename T> constexpr int mask_bits_per_sample = std::is_same_v<T, short> ? 2 : 1;
+
+// has mask_bits_per_sample bits set for each of the next samples which is louder than the threshold
+template <typename T> int get_loud_mask(const T *samples, T threshold) {
+    if constexpr (std::is_same_v<T, float>) {
+        __m128 magnitude = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_loadu_ps(samples));
+        return _mm_movemask_ps(_mm_cmpgt_ps(magnitude, _mm_set1_ps(threshold)));
+    } else {
+        __m128i x = _mm_loadu_si128((const __m128i *)samples);
+        __m128i limit = _mm_set1_epi16(threshold);
+        __m128i negative_limit = _mm_sub_epi16(_mm_setzero_si128(), limit);
+        return _mm_movemask_epi8(_mm_or_si128(_mm_cmpgt_epi16(x, limit), _mm_cmplt_epi16(x, negative_limit)));
+    }
+}
+#endif
+
+// @return the index of the first sample louder than the threshold, count if there isn't one
+template <typename T> size_t find_first_loud_sample(const T *samples, size_t count, T threshold) {
+    size_t i = 0;
+#ifdef LOAD_SOUND_FILE_SSE
+    constexpr size_t width = samples_per_vector<T>;
+    for (; i + width <= count; i += width) {
+        int mask = get_loud_mask(samples + i, threshold);
+        if (mask != 0) {
+            return i + std::countr_zero((unsigned)mask) / mask_bits_per_sample<T>;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (is_loud(samples[i], threshold)) {
+            return i;
+        }
+    }
+    return count;
+}
+
+// @return one past the last sample louder than the threshold, 0 if there isn't one
+template <typename T> size_t find_end_of_loud_samples(const T *samples, size_t count, T threshold) {
+    size_t end = count;
+#ifdef LOAD_SOUND_FILE_SSE
+    constexpr size_t width = samples_per_vector<T>;
+    for (; end >= width; end -= width) {
+        int mask = get_loud_mask(samples + end - width, threshold);
+        if (mask != 0) {
+            return end - width + (std::bit_width((unsigned)mask) - 1) / mask_bits_per_sample<T> + 1;
+        }
+    }
+#endif
+    for (; end > 0; end--) {
+        if (is_loud(samples[end - 1], threshold)) {
+            return end;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Finds the frames between the first and last one with a sample above the threshold, the scans run over the samples
+ * without regard for frames and are then rounded out to whole frames. A silent sound keeps its first frame.
+ */
+template <typename T>
+void find_loud_frames(const T *samples, size_t num_frames, int channels, T threshold, size_t &first_frame,
+                      size_t &end_frame) {
+    size_t num_samples = num_frames * channels;
+    size_t first = find_first_loud_sample(samples, num_samples, threshold);
+    if (first == num_samples) {
+        first_frame = 0;
+        end_frame = std::min<size_t>(num_frames, 1);
+        return;
+    }
+    first_frame = first / channels;
+    end_frame = (find_end_of_loud_samples(samples + first, num_samples - first, threshold) + first + channels - 1) /
+                channels;
+}
+
+struct FreeDeleter {
+    void operator()(void *memory) const { free(memory); }
+};
+using DecodeBuffer = std::unique_ptr<void, FreeDeleter>;
+
+} // namespace
+
+int get_sound_file_channel_count(const char *filename) {
+    SoundFileHandle sound_file;
+    SF_INFO sound_file_info;
+    LoadResult result;
+    result.error = open_audio_file(filename, sound_file, sound_file_info, result.detail);
+    if (!result) {
+        throw_load_failure(filename, result);
+    }
+    return sound_file_info.channels;
+}
+
+/* Figure out the OpenAL format from the file and desired sample type, AL_NONE if there isn't one. */
+ALenum determine_openal_format(SNDFILE *sound_file, const SF_INFO &sound_file_info, enum FormatType sample_format,
+                               ALint &ambisonic_order) {
     //    TODO turn into map
     ALenum format = AL_NONE;
     if (sound_file_info.channels == 1) {
@@ -317,120 +529,402 @@ ALenum determine_openal_format(SNDFILE *sound_file, SF_INFO sound_file_info, enu
             format = AL_FORMAT_STEREO_IMA4;
         else if (sample_format == MSADPCM)
             format = AL_FORMAT_STEREO_MSADPCM_SOFT;
-    } else if (sound_file_info.channels == 3) {
-        if (sf_command(sound_file, SFC_WAVEX_GET_AMBISONIC, NULL, 0) == SF_AMBISONIC_B_FORMAT) {
-            if (sample_format == Int16)
-                format = AL_FORMAT_BFORMAT2D_16;
-            else if (sample_format == Float)
-                format = AL_FORMAT_BFORMAT2D_FLOAT32;
-        }
-    } else if (sound_file_info.channels == 4) {
-        if (sf_command(sound_file, SFC_WAVEX_GET_AMBISONIC, NULL, 0) == SF_AMBISONIC_B_FORMAT) {
-            if (sample_format == Int16)
-                format = AL_FORMAT_BFORMAT3D_16;
-            else if (sample_format == Float)
-                format = AL_FORMAT_BFORMAT3D_FLOAT32;
-        }
-    }
-    if (!format) {
-        sf_close(sound_file); // we might not want to do this in general
-        throw std::runtime_error("Unsupported channel count: " + patch::to_string(sound_file_info.channels));
+    } else if (sample_format == Int16 || sample_format == Float) {
+        bool ambisonic = sf_command(sound_file, SFC_WAVEX_GET_AMBISONIC, NULL, 0) == SF_AMBISONIC_B_FORMAT;
+        format = get_multichannel_openal_format(sound_file_info.channels, ambisonic, sample_format == Float,
+                                                ambisonic_order);
     }
     return format;
 }
 
 /**
  * Decode the whole audio file to a buffer
- * @return the pointer to dynamic memory, along with the number of bytes it takes up
+ * @param membuf set to the decoded data, which takes up num_bytes
  */
-std::tuple<void *, ALsizei> decode_audio_file_into_dynamic_memory(const char *filename, SNDFILE *sound_file,
-                                                                  SF_INFO sound_file_info,
-                                                                  enum FormatType sample_format, ALenum format,
-                                                                  ALint byteblockalign, ALint splblockalign) {
-    /* Decode the whole audio file to a buffer. */
+LoadError decode_audio_file_into_dynamic_memory(SNDFILE *sound_file, const SF_INFO &sound_file_info,
+                                                enum FormatType sample_format, ALint byteblockalign,
+                                                ALint splblockalign, DecodeBuffer &membuf, ALsizei &num_bytes) {
     sf_count_t num_frames;
-    ALsizei num_bytes;
-    void *membuf = malloc((size_t)(sound_file_info.frames / splblockalign * byteblockalign));
+    membuf.reset(malloc((size_t)(sound_file_info.frames / splblockalign * byteblockalign)));
+    if (!membuf) {
+        return LoadError::out_of_memory;
+    }
     if (sample_format == Int16)
-        num_frames = sf_readf_short(sound_file, (short *)membuf, sound_file_info.frames);
+        num_frames = sf_readf_short(sound_file, (short *)membuf.get(), sound_file_info.frames);
     else if (sample_format == Float)
-        num_frames = sf_readf_float(sound_file, (float *)membuf, sound_file_info.frames);
+        num_frames = sf_readf_float(sound_file, (float *)membuf.get(), sound_file_info.frames);
     else {
         sf_count_t count = sound_file_info.frames / splblockalign * byteblockalign;
-        num_frames = sf_read_raw(sound_file, membuf, count);
+        num_frames = sf_read_raw(sound_file, membuf.get(), count);
         if (num_frames > 0)
             num_frames = num_frames / byteblockalign * splblockalign;
     }
     if (num_frames < 1) {
-        free(membuf);
-        sf_close(sound_file);
-        fprintf(stderr, "Failed to read samples in %s (%" PRId64 ")\n", filename, num_frames);
-        throw std::runtime_error("failed to read samples");
+        return LoadError::read_failed;
     }
 
     num_bytes = (ALsizei)(num_frames / splblockalign * byteblockalign);
-
-    if (openal_format_enum_to_string.find(format) == openal_format_enum_to_string.end()) {
-        printf("Loading: %s (%s, %dhz)\n", filename, openal_format_enum_to_string[format], sound_file_info.samplerate);
-        ;
-    }
-
-    fflush(stdout);
-
-    return {membuf, num_bytes};
+    return LoadError::none;
 }
 
 /**
- *
- * Buffer the audio data into a new buffer object, then free the data and
- * close the file.
- *
- * @return the identifier to the openal buffer
+ * Buffer the audio data into a new buffer object, the buffer is deleted again if OpenAL reports an error
+ * @param loop_points the start and end frame of the loop, nullptr to loop the whole buffer
+ * @param al_error set to the error if there was one
  */
-ALuint load_audio_file_in_dynamic_memory_into_buffer(void *membuf, SNDFILE *sound_file, SF_INFO sound_file_info,
-                                                     ALsizei num_bytes, ALenum format, ALint splblockalign) {
-    ALenum err;
-    ALuint buffer;
+LoadError load_audio_file_in_dynamic_memory_into_buffer(const void *membuf, const SF_INFO &sound_file_info,
+                                                        ALsizei num_bytes, ALenum format, ALint splblockalign,
+                                                        ALint ambisonic_order, const ALint *loop_points,
+                                                        ALuint &buffer, int &al_error) {
     buffer = 0;
     alGenBuffers(1, &buffer);
     if (splblockalign > 1)
         alBufferi(buffer, AL_UNPACK_BLOCK_ALIGNMENT_SOFT, splblockalign);
+    if (ambisonic_order > 1)
+        alBufferi(buffer, AL_UNPACK_AMBISONIC_ORDER_SOFT, ambisonic_order);
     alBufferData(buffer, format, membuf, num_bytes, sound_file_info.samplerate);
-
-    free(membuf);
-    sf_close(sound_file);
+    // loop points can only be set once the buffer has data
+    if (loop_points)
+        alBufferiv(buffer, AL_LOOP_POINTS_SOFT, loop_points);
 
     /* Check if an error occurred, and clean up if so. */
-    err = alGetError();
+    ALenum err = alGetError();
     if (err != AL_NO_ERROR) {
-        fprintf(stderr, "OpenAL Error: %s\n", alGetString(err));
+        al_error = err;
         if (buffer && alIsBuffer(buffer))
             alDeleteBuffers(1, &buffer);
-        throw std::runtime_error("openal error");
+        buffer = 0;
+        return LoadError::openal_error;
+    }
+    return LoadError::none;
+}
+
+/*
+ * Reads the first loop of the file's instrument, which for a wav comes from its 'smpl' chunk
+ * @return false if there isn't a usable one
+ */
+bool read_loop_points(SNDFILE *sound_file, const SF_INFO &sound_file_info, ALint loop_points[2]) {
+    SF_INSTRUMENT instrument;
+    if (sf_command(sound_file, SFC_GET_INSTRUMENT, &instrument, sizeof(instrument)) != SF_TRUE ||
+        instrument.loop_count < 1 || instrument.loops[0].mode == SF_LOOP_NONE) {
+        return false;
+    }
+    sf_count_t start = instrument.loops[0].start;
+    sf_count_t end = instrument.loops[0].end;
+    if (start >= end || end > sound_file_info.frames || end > INT_MAX) {
+        return false;
+    }
+    loop_points[0] = (ALint)start;
+    loop_points[1] = (ALint)end;
+    return true;
+}
+
+namespace {
+
+// a file decoded into memory with its silence trimmed, everything a load does before the samples go anywhere
+struct DecodedSoundFile {
+    SF_INFO info;
+    enum FormatType sample_format = Int16;
+    ALint byteblockalign = 0;
+    ALint splblockalign = 0;
+    ALenum format = AL_NONE; // not looked up when decoding for the cpu
+    ALint ambisonic_order = 0;
+    ALint loop_points[2];
+    bool has_loop_points = false;
+    DecodeBuffer membuf;
+    const char *samples = nullptr; // into membuf, past the trimmed silence
+    ALsizei num_bytes = 0;
+};
+
+/**
+ * Both kinds of load go through here, so samples kept on the cpu are trimmed exactly as the buffer of the same file
+ * @param for_cpu ADPCM is decoded to 16 bit instead of read raw, it's still left untrimmed as it is in a buffer
+ */
+LoadResult decode_sound_file(const char *filename, const LoadOptions &options, bool for_cpu,
+                             DecodedSoundFile &decoded) {
+    LoadResult result;
+    SoundFileHandle sound_file;
+    SF_INFO &sound_file_info = decoded.info;
+
+    result.stage = LoadStage::open;
+    result.error = open_audio_file(filename, sound_file, sound_file_info, result.detail);
+    if (!result) {
+        return result;
+    }
+
+    result.stage = LoadStage::format;
+    decoded.sample_format = determine_format_type(sound_file_info);
+    result.error = get_byte_and_samples_per_block_alignment(decoded.sample_format, sound_file.get(), sound_file_info,
+                                                            decoded.byteblockalign, decoded.splblockalign);
+    if (!result) {
+        return result;
+    }
+    // ADPCM can only be cut on block boundaries so it's kept whole
+    bool can_trim = decoded.sample_format == Int16 || decoded.sample_format == Float;
+    if (for_cpu && !can_trim) {
+        decoded.sample_format = Int16;
+        result.error = get_byte_and_samples_per_block_alignment(decoded.sample_format, sound_file.get(),
+                                                                sound_file_info, decoded.byteblockalign,
+                                                                decoded.splblockalign);
+        if (!result) {
+            return result;
+        }
+    }
+    if (!for_cpu) {
+        decoded.format = determine_openal_format(sound_file.get(), sound_file_info, decoded.sample_format,
+                                                 decoded.ambisonic_order);
+        if (decoded.format == AL_NONE) {
+            result.error = LoadError::unsupported_channels;
+            result.detail = sound_file_info.channels;
+            return result;
+        }
+    }
+
+    ALint *loop_points = decoded.loop_points;
+    decoded.has_loop_points = options.use_loop_points && alIsExtensionPresent("AL_SOFT_loop_points") &&
+                              read_loop_points(sound_file.get(), sound_file_info, loop_points);
+
+    result.stage = LoadStage::decode;
+    result.error = decode_audio_file_into_dynamic_memory(sound_file.get(), sound_file_info, decoded.sample_format,
+                                                         decoded.byteblockalign, decoded.splblockalign,
+                                                         decoded.membuf, decoded.num_bytes);
+    if (!result) {
+        return result;
     }
+    // everything needed is in memory now, so the file isn't held open through the upload
+    sound_file.reset();
 
-    return buffer;
+    // the silence is left in memory and just not uploaded
+    decoded.samples = (const char *)decoded.membuf.get();
+    ALint byteblockalign = decoded.byteblockalign;
+    if (options.trim_silence && can_trim) {
+        size_t num_frames = (size_t)(decoded.num_bytes / byteblockalign);
+        float threshold = std::pow(10.0f, options.silence_threshold_db / 20.0f);
+        size_t first_frame, end_frame;
+        if (decoded.sample_format == Int16) {
+            short int16_threshold = (short)std::min(threshold * 32768.0f, 32767.0f);
+            find_loud_frames((const short *)decoded.samples, num_frames, sound_file_info.channels, int16_threshold,
+                             first_frame, end_frame);
+        } else {
+            find_loud_frames((const float *)decoded.samples, num_frames, sound_file_info.channels, threshold,
+                             first_frame, end_frame);
+        }
+        if (decoded.has_loop_points) {
+            first_frame = std::min(first_frame, (size_t)loop_points[0]);
+            end_frame = std::max(end_frame, std::min((size_t)loop_points[1], num_frames));
+            loop_points[0] -= (ALint)first_frame;
+            loop_points[1] -= (ALint)first_frame;
+        }
+        decoded.samples += first_frame * byteblockalign;
+        decoded.num_bytes = (ALsizei)((end_frame - first_frame) * byteblockalign);
+    }
+
+    // a loop past what was read would be rejected by OpenAL
+    if (decoded.has_loop_points &&
+        (sf_count_t)loop_points[1] > (sf_count_t)decoded.num_bytes / byteblockalign * decoded.splblockalign) {
+        decoded.has_loop_points = false;
+    }
+    return result;
+}
+
+// averages the channels of each frame, scale turns the samples into floats in [-1, 1]
+template <typename T>
+void mix_down_to_mono(const T *interleaved, size_t num_frames, int channels, float scale, std::vector<float> &mono) {
+    mono.resize(num_frames);
+    float channel_scale = scale / (float)channels;
+    for (size_t frame = 0; frame < num_frames; frame++) {
+        float sum = 0;
+        for (int channel = 0; channel < channels; channel++) {
+            sum += (float)interleaved[frame * channels + channel];
+        }
+        mono[frame] = sum * channel_scale;
+    }
+}
+
+/**
+ * Calls load with the index of every file, spreading the files over worker threads which each bind the context for
+ * themselves. Without ALC_EXT_thread_local_context the files are loaded one after the other on the calling thread.
+ */
+template <typename Load>
+void load_each_file(size_t num_files, const OpenALExtensions &extensions, ALCcontext *context, unsigned num_threads,
+                    const Load &load) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::min<unsigned>(num_threads, (unsigned)num_files);
+
+    if (!extensions.alcSetThreadContext || num_threads <= 1) {
+        for (size_t i = 0; i < num_files; i++) {
+            load(i);
+        }
+        return;
+    }
+    // files are handed out one at a time so a few large files don't leave the other threads idle
+    std::atomic<size_t> next_file{0};
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker < num_threads; worker++) {
+        workers.emplace_back([&] {
+            ThreadContextBinding binding(extensions, context);
+            for (size_t i = next_file++; i < num_files; i = next_file++) {
+                load(i);
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+} // namespace
+
+LoadResult try_load_sound_into_openal_buffer(const char *filename, const LoadOptions &options,
+                                             LoudnessEnvelope *loudness_envelope) {
+    DecodedSoundFile decoded;
+    LoadResult result = decode_sound_file(filename, options, false, decoded);
+    if (!result) {
+        return result;
+    }
+
+    // measured from the samples while they're still warm in the cache, ADPCM would have to be decoded first
+    const SF_INFO &sound_file_info = decoded.info;
+    if (decoded.sample_format == Int16 || decoded.sample_format == Float) {
+        LoudnessMeter meter(sound_file_info.channels, sound_file_info.samplerate);
+        size_t num_frames = (size_t)(decoded.num_bytes / decoded.byteblockalign);
+        if (decoded.sample_format == Int16) {
+            meter.add_frames((const short *)decoded.samples, num_frames);
+        } else {
+            meter.add_frames((const float *)decoded.samples, num_frames);
+        }
+        result.loudness = meter.get_integrated_loudness();
+        if (loudness_envelope) {
+            *loudness_envelope = meter.get_loudness_envelope();
+        }
+    }
+
+    result.stage = LoadStage::upload;
+    result.error = load_audio_file_in_dynamic_memory_into_buffer(
+        decoded.samples, sound_file_info, decoded.num_bytes, decoded.format, decoded.splblockalign,
+        decoded.ambisonic_order, decoded.has_loop_points ? decoded.loop_points : nullptr, result.buffer,
+        result.detail);
+    return result;
 }
 
 /*
  * LoadBuffer loads the named audio file into an OpenAL buffer object, and
  * returns the new buffer ID.
  */
-ALuint load_sound_and_generate_openal_buffer(const char *filename) {
-    SNDFILE *sound_file;
-    SF_INFO sound_file_info;
-    ALenum format;
+ALuint load_sound_and_generate_openal_buffer(const char *filename, float *loudness, const LoadOptions &options,
+                                             LoudnessEnvelope *loudness_envelope) {
+    LoadResult result = try_load_sound_into_openal_buffer(filename, options, loudness_envelope);
+    if (!result) {
+        throw_load_failure(filename, result);
+    }
+    if (loudness) {
+        *loudness = result.loudness;
+    }
+    return result.buffer;
+}
 
-    open_audio_file(filename, &sound_file, &sound_file_info);
-    enum FormatType sample_format = determine_format_type(sound_file_info);
-    auto [byteblockalign, splblockalign] =
-        get_byte_and_samples_per_block_alignment(sample_format, filename, sound_file, sound_file_info);
-    format = determine_openal_format(sound_file, sound_file_info, sample_format);
-    auto [membuf, num_bytes] = decode_audio_file_into_dynamic_memory(
-        filename, sound_file, sound_file_info, sample_format, format, byteblockalign, splblockalign);
+BatchLoadReport try_load_sounds_in_parallel(const std::vector<std::string> &filenames,
+                                            const OpenALExtensions &extensions, ALCcontext *context,
+                                            unsigned num_threads, const LoadOptions &options) {
+    std::vector<LoadResult> results(filenames.size());
+    BatchLoadReport report;
+    report.loudness_envelopes.resize(filenames.size());
+    load_each_file(filenames.size(), extensions, context, num_threads, [&](size_t i) {
+        results[i] = try_load_sound_into_openal_buffer(filenames[i].c_str(), options, &report.loudness_envelopes[i]);
+    });
 
-    ALuint buffer = load_audio_file_in_dynamic_memory_into_buffer(membuf, sound_file, sound_file_info, num_bytes,
-                                                                  format, splblockalign);
+    report.buffers.resize(filenames.size());
+    report.loudness.resize(filenames.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        report.buffers[i] = results[i].buffer;
+        report.loudness[i] = results[i].loudness;
+        if (!results[i]) {
+            report.failures.push_back({i, results[i]});
+        }
+    }
+    return report;
+}
 
-    return buffer;
+std::vector<ALuint> load_sounds_in_parallel(const std::vector<std::string> &filenames,
+                                            const OpenALExtensions &extensions, ALCcontext *context,
+                                            unsigned num_threads, std::vector<float> *loudness,
+                                            const LoadOptions &options,
+                                            std::vector<LoudnessEnvelope> *loudness_envelopes) {
+    BatchLoadReport report = try_load_sounds_in_parallel(filenames, extensions, context, num_threads, options);
+    if (report.failures.empty()) {
+        if (loudness) {
+            *loudness = std::move(report.loudness);
+        }
+        if (loudness_envelopes) {
+            *loudness_envelopes = std::move(report.loudness_envelopes);
+        }
+        return report.buffers;
+    }
+
+    for (const LoadFailure &failure : report.failures) {
+        print_load_failure(filenames[failure.file_index].c_str(), failure.result);
+    }
+    for (ALuint buffer : report.buffers) {
+        if (buffer) {
+            alDeleteBuffers(1, &buffer);
+        }
+    }
+    const LoadFailure &first = report.failures.front();
+    throw std::runtime_error(std::to_string(report.failures.size()) + " sound files failed to load, the first was " +
+                             filenames[first.file_index] + ": " + get_load_error_name(first.result.error));
+}
+
+LoadResult try_load_sound_into_pcm(const char *filename, PcmBuffer &pcm, const LoadOptions &options) {
+    DecodedSoundFile decoded;
+    LoadResult result = decode_sound_file(filename, options, true, decoded);
+    if (!result) {
+        return result;
+    }
+
+    const SF_INFO &sound_file_info = decoded.info;
+    size_t num_frames = (size_t)(decoded.num_bytes / decoded.byteblockalign);
+    pcm.sample_rate = sound_file_info.samplerate;
+    if (decoded.sample_format == Int16) {
+        mix_down_to_mono((const short *)decoded.samples, num_frames, sound_file_info.channels, 1.0f / 32768.0f,
+                         pcm.samples);
+    } else {
+        mix_down_to_mono((const float *)decoded.samples, num_frames, sound_file_info.channels, 1.0f, pcm.samples);
+    }
+    return result;
+}
+
+PcmBuffer load_sound_file_into_pcm(const char *filename, const LoadOptions &options) {
+    PcmBuffer pcm;
+    LoadResult result = try_load_sound_into_pcm(filename, pcm, options);
+    if (!result) {
+        throw_load_failure(filename, result);
+    }
+    return pcm;
+}
+
+std::vector<PcmBuffer> load_sounds_into_pcm_in_parallel(const std::vector<std::string> &filenames,
+                                                        const OpenALExtensions &extensions, ALCcontext *context,
+                                                        unsigned num_threads, const LoadOptions &options) {
+    std::vector<PcmBuffer> pcm(filenames.size());
+    std::vector<LoadResult> results(filenames.size());
+    load_each_file(filenames.size(), extensions, context, num_threads, [&](size_t i) {
+        results[i] = try_load_sound_into_pcm(filenames[i].c_str(), pcm[i], options);
+    });
+
+    size_t num_failures = 0;
+    const std::string *first_failure = nullptr;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!results[i]) {
+            print_load_failure(filenames[i].c_str(), results[i]);
+            first_failure = first_failure ? first_failure : &filenames[i];
+            num_failures++;
+        }
+    }
+    if (num_failures > 0) {
+        throw std::runtime_error(std::to_string(num_failures) + " sound files failed to decode, the first was " +
+                                 *first_failure);
+    }
+    return pcm;
 }
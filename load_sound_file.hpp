@@ -2,7 +2,167 @@
 #define OPENAL_MWE_LOAD_SOUND_FILE_HPP
 
 #include <AL/al.h>
+#include <cstdint>
+#include <memory>
+#include <sndfile.h>
+#include <string>
+#include <vector>
 
-ALuint load_sound_and_generate_openal_buffer(const char *filename);
+#include "loudness.hpp"
+#include "openal_extensions.hpp"
+
+struct SoundFileCloser {
+    void operator()(SNDFILE *sound_file) const { sf_close(sound_file); }
+};
+using SoundFileHandle = std::unique_ptr<SNDFILE, SoundFileCloser>;
+
+// where in loading a file it failed
+enum class LoadStage : uint8_t { open, format, decode, upload };
+
+enum class LoadError : uint8_t {
+    none,
+    cant_open,            // detail is libsndfile's error number, best effort when loading in parallel
+    no_samples,
+    too_many_samples,     // more bytes than an OpenAL buffer can take
+    unsupported_channels, // detail is the channel count
+    out_of_memory,
+    read_failed,
+    openal_error,         // detail is the OpenAL error
+};
+
+const char *get_load_error_name(LoadError error);
+const char *get_load_stage_name(LoadStage stage);
+
+/**
+ * The outcome of loading one file, it's a few bytes and holds no strings, so reporting a failure doesn't allocate or
+ * unwind
+ */
+struct LoadResult {
+    ALuint buffer = 0; // only set when the load succeeded
+    LoadError error = LoadError::none;
+    LoadStage stage = LoadStage::open;
+    int detail = 0;
+    // integrated loudness in LUFS, measured from the decoded samples, ADPCM files are left unmeasured
+    float loudness = unmeasured_loudness;
+
+    explicit operator bool() const { return error == LoadError::none; }
+};
+
+struct LoadOptions {
+    /**
+     * Leaves the silence at the start and end out of the buffer, a file's loop is always kept whole. Samples at or
+     * below the threshold count as silence.
+     */
+    bool trim_silence = false;
+    float silence_threshold_db = -60.0f;
+    // loops a looping source between the loop points of the file's 'smpl' chunk, needs AL_SOFT_loop_points
+    bool use_loop_points = true;
+};
+
+/**
+ * Loads the file into a new buffer, nothing is printed or thrown when it fails
+ * @param loudness_envelope if given it's set to the envelope of what was uploaded, it's left empty for ADPCM
+ */
+LoadResult try_load_sound_into_openal_buffer(const char *filename, const LoadOptions &options = {},
+                                             LoudnessEnvelope *loudness_envelope = nullptr);
+
+/**
+ * @param loudness if given it's set to the loudness of the file
+ * @throw std::runtime_error if the file can't be loaded, after printing why
+ */
+ALuint load_sound_and_generate_openal_buffer(const char *filename, float *loudness = nullptr,
+                                             const LoadOptions &options = {},
+                                             LoudnessEnvelope *loudness_envelope = nullptr);
+
+/**
+ * Whether the loader decodes files of this libsndfile format as float (when AL_EXT_FLOAT32 is present) rather than as
+ * 16 bit, which is the case for formats with more precision than 16 bits
+ */
+bool is_float_source_format(int sndfile_format);
+
+/**
+ * A full 3D ambisonic set of order n has (n + 1)^2 channels and a 2D (horizontal only) one has 2n + 1
+ * @return the order, up to third, or 0 if the channels aren't a full set
+ */
+ALint get_ambisonic_order(int channels, bool &three_dimensional);
+
+/**
+ * Reads the block alignment of an IMA4 or MS ADPCM wav from its 'fmt ' chunk, this only touches the header
+ * @return false if the chunk is missing or the alignment doesn't make sense for the channel count
+ */
+bool read_adpcm_block_alignment(SNDFILE *sound_file, int channels, bool ima4, ALint &byte_block_alignment,
+                                ALint &samples_per_block);
+
+/**
+ * Maps a layout with more than two channels onto an OpenAL format, quad, 5.1, 6.1 and 7.1 for plain files and B-Format
+ * for ambisonic ones. Ambisonics above first order need AL_SOFT_bformat_hoa and the buffer's
+ * AL_UNPACK_AMBISONIC_ORDER_SOFT set to the order.
+ * @param ambisonic_order set to the ambisonic order, 0 for plain files
+ * @return AL_NONE if OpenAL has no format for the layout
+ */
+ALenum get_multichannel_openal_format(int channels, bool ambisonic, bool float_samples, ALint &ambisonic_order);
+
+// only reads the header, so it's cheap enough to decide how to load a file
+int get_sound_file_channel_count(const char *filename);
+
+struct LoadFailure {
+    size_t file_index;
+    LoadResult result;
+};
+
+struct BatchLoadReport {
+    std::vector<ALuint> buffers; // in the same order as the filenames, 0 for the files which failed
+    std::vector<float> loudness; // in the same order as the filenames
+    std::vector<LoudnessEnvelope> loudness_envelopes; // in the same order as the filenames
+    std::vector<LoadFailure> failures;
+};
+
+/**
+ * Loads every file into its own buffer, spreading the decoding and uploading over worker threads which each bind the
+ * context for themselves. Without ALC_EXT_thread_local_context the files are loaded one after the other on the
+ * calling thread. A failure doesn't stop the batch, every file is tried and every failure is in the report.
+ * @param num_threads 0 uses every core
+ */
+BatchLoadReport try_load_sounds_in_parallel(const std::vector<std::string> &filenames,
+                                            const OpenALExtensions &extensions, ALCcontext *context,
+                                            unsigned num_threads = 0, const LoadOptions &options = {});
+
+/**
+ * try_load_sounds_in_parallel for callers which can't go on without every file
+ * @param loudness if given it's filled with the loudness of each file
+ * @param loudness_envelopes if given it's filled with the loudness envelope of each file
+ * @return the buffers in the same order as the filenames
+ * @throw std::runtime_error after printing every failure, none of the buffers are kept
+ */
+std::vector<ALuint> load_sounds_in_parallel(const std::vector<std::string> &filenames,
+                                            const OpenALExtensions &extensions, ALCcontext *context,
+                                            unsigned num_threads = 0, std::vector<float> *loudness = nullptr,
+                                            const LoadOptions &options = {},
+                                            std::vector<LoudnessEnvelope> *loudness_envelopes = nullptr);
+
+// Decoded samples kept on the cpu, downmixed to mono so that they can be positioned by the software mixer
+struct PcmBuffer {
+    std::vector<float> samples;
+    int sample_rate = 0;
+};
+
+/**
+ * Decodes the file as loading it into a buffer would, with the same options and so the same trimmed silence, but
+ * averages the channels down to mono and keeps the samples on the cpu. Nothing is printed or thrown when it fails.
+ */
+LoadResult try_load_sound_into_pcm(const char *filename, PcmBuffer &pcm, const LoadOptions &options = {});
+
+// @throw std::runtime_error if the file can't be loaded, after printing why
+PcmBuffer load_sound_file_into_pcm(const char *filename, const LoadOptions &options = {});
+
+/**
+ * load_sound_file_into_pcm for every file, spread over worker threads as try_load_sounds_in_parallel does, the
+ * context is only needed to look up the same extensions a buffer load would
+ * @return the samples in the same order as the filenames
+ * @throw std::runtime_error after printing every failure
+ */
+std::vector<PcmBuffer> load_sounds_into_pcm_in_parallel(const std::vector<std::string> &filenames,
+                                                        const OpenALExtensions &extensions, ALCcontext *context,
+                                                        unsigned num_threads = 0, const LoadOptions &options = {});
 
 #endif // OPENAL_MWE_LOAD_SOUND_FILE_HPP
@@ -0,0 +1,263 @@
+#include "loudness.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LOUDNESS_SSE
+#endif
+
+namespace {
+
+constexpr int lanes = 4;
+constexpr size_t conversion_frames = 1024;
+
+// the loudness of a weighted mean square, as BS.1770 defines it
+double energy_to_loudness(double energy) { return -0.691 + 10.0 * std::log10(energy); }
+double loudness_to_energy(double loudness) { return std::pow(10.0, (loudness + 0.691) / 10.0); }
+
+#ifdef LOUDNESS_SSE
+// the channels past the end of the frame are left at 0
+__m128 load_channels(const float *samples, int count) {
+    switch (count) {
+    case 1:
+        return _mm_load_ss(samples);
+    case 2:
+        return _mm_castpd_ps(_mm_load_sd((const double *)samples));
+    case 3:
+        return _mm_setr_ps(samples[0], samples[1], samples[2], 0.0f);
+    }
+    return _mm_loadu_ps(samples);
+}
+#endif
+
+} // namespace
+
+LoudnessMeter::LoudnessMeter(int channels, int sample_rate)
+    : channels(channels), padded_channels((channels + lanes - 1) / lanes * lanes) {
+    // the filters are the ones BS.1770 gives for 48kHz, redesigned for the sample rate with the bilinear transform
+    double rate = (double)sample_rate;
+    const double pi = 3.14159265358979323846;
+
+    double f0 = 1681.974450955533;
+    double gain_db = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = std::tan(pi * f0 / rate);
+    double vh = std::pow(10.0, gain_db / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    shelf.b0 = (float)((vh + vb * k / q + k * k) / a0);
+    shelf.b1 = (float)(2.0 * (k * k - vh) / a0);
+    shelf.b2 = (float)((vh - vb * k / q + k * k) / a0);
+    shelf.a1 = (float)(2.0 * (k * k - 1.0) / a0);
+    shelf.a2 = (float)((1.0 - k / q + k * k) / a0);
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(pi * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+    high_pass.b0 = 1.0f;
+    high_pass.b1 = -2.0f;
+    high_pass.b2 = 1.0f;
+    high_pass.a1 = (float)(2.0 * (k * k - 1.0) / a0);
+    high_pass.a2 = (float)((1.0 - k / q + k * k) / a0);
+
+    filter_state.assign(4 * padded_channels, 0.0f);
+    channel_sums.assign(padded_channels, 0.0f);
+    // the lfe of 5.1 and 7.1 isn't counted and the surrounds are weighted up, everything else counts the same
+    channel_weights.assign(padded_channels, 0.0f);
+    std::fill(channel_weights.begin(), channel_weights.begin() + channels, 1.0f);
+    if (channels == 6 || channels == 8) {
+        channel_weights[3] = 0.0f;
+        std::fill(channel_weights.begin() + 4, channel_weights.begin() + channels, 1.41f);
+    }
+    sub_block_frames = std::max<size_t>(1, (size_t)sample_rate / 10);
+}
+
+void LoudnessMeter::add_frames(const float *interleaved, size_t num_frames) {
+    while (num_frames > 0) {
+        size_t count = std::min(num_frames, sub_block_frames - frames_in_sub_block);
+        filter(interleaved, count);
+        interleaved += count * channels;
+        num_frames -= count;
+        frames_in_sub_block += count;
+        if (frames_in_sub_block == sub_block_frames) {
+            sub_block_energies.push_back(get_channel_sums_energy(sub_block_frames));
+            std::fill(channel_sums.begin(), channel_sums.end(), 0.0f);
+            frames_in_sub_block = 0;
+        }
+    }
+}
+
+void LoudnessMeter::add_frames(const short *interleaved, size_t num_frames) {
+    conversion.resize(conversion_frames * channels);
+    const float scale = 1.0f / 32768.0f;
+    while (num_frames > 0) {
+        size_t count = std::min(num_frames, conversion_frames);
+        size_t num_samples = count * channels;
+        size_t i = 0;
+#ifdef LOUDNESS_SSE
+        __m128 scale_ps = _mm_set1_ps(scale);
+        for (; i + 8 <= num_samples; i += 8) {
+            __m128i samples = _mm_loadu_si128((const __m128i *)(interleaved + i));
+            // sign extend by putting each sample in the top half of a 32 bit lane and shifting it back down
+            __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+            __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+            _mm_storeu_ps(conversion.data() + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale_ps));
+            _mm_storeu_ps(conversion.data() + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale_ps));
+        }
+#endif
+        for (; i < num_samples; i++) {
+            conversion[i] = (float)interleaved[i] * scale;
+        }
+        add_frames(conversion.data(), count);
+        interleaved += num_samples;
+        num_frames -= count;
+    }
+}
+
+/*
+ * Runs both filters over the frames a group of channels at a time, so each group's filter state stays in registers
+ * for the whole run, and adds the squared output to the channel sums.
+ */
+void LoudnessMeter::filter(const float *interleaved, size_t num_frames) {
+    float *shelf_z1 = filter_state.data();
+    float *shelf_z2 = shelf_z1 + padded_channels;
+    float *high_pass_z1 = shelf_z2 + padded_channels;
+    float *high_pass_z2 = high_pass_z1 + padded_channels;
+
+    for (int first = 0; first < channels; first += lanes) {
+        int count = std::min(lanes, channels - first);
+#ifdef LOUDNESS_SSE
+        __m128 s_b0 = _mm_set1_ps(shelf.b0), s_b1 = _mm_set1_ps(shelf.b1), s_b2 = _mm_set1_ps(shelf.b2);
+        __m128 s_a1 = _mm_set1_ps(shelf.a1), s_a2 = _mm_set1_ps(shelf.a2);
+        __m128 h_a1 = _mm_set1_ps(high_pass.a1), h_a2 = _mm_set1_ps(high_pass.a2);
+        __m128 s_z1 = _mm_loadu_ps(shelf_z1 + first), s_z2 = _mm_loadu_ps(shelf_z2 + first);
+        __m128 h_z1 = _mm_loadu_ps(high_pass_z1 + first), h_z2 = _mm_loadu_ps(high_pass_z2 + first);
+        __m128 sum = _mm_setzero_ps();
+        const float *samples = interleaved + first;
+        for (size_t frame = 0; frame < num_frames; frame++, samples += channels) {
+            // transposed direct form II
+            __m128 x = load_channels(samples, count);
+            __m128 y = _mm_add_ps(_mm_mul_ps(s_b0, x), s_z1);
+            s_z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(s_b1, x), _mm_mul_ps(s_a1, y)), s_z2);
+            s_z2 = _mm_sub_ps(_mm_mul_ps(s_b2, x), _mm_mul_ps(s_a2, y));
+            // the high pass's numerator is 1, -2, 1
+            x = y;
+            y = _mm_add_ps(x, h_z1);
+            h_z1 = _mm_sub_ps(_mm_sub_ps(h_z2, _mm_add_ps(x, x)), _mm_mul_ps(h_a1, y));
+            h_z2 = _mm_sub_ps(x, _mm_mul_ps(h_a2, y));
+            sum = _mm_add_ps(sum, _mm_mul_ps(y, y));
+        }
+        _mm_storeu_ps(shelf_z1 + first, s_z1);
+        _mm_storeu_ps(shelf_z2 + first, s_z2);
+        _mm_storeu_ps(high_pass_z1 + first, h_z1);
+        _mm_storeu_ps(high_pass_z2 + first, h_z2);
+        _mm_storeu_ps(channel_sums.data() + first, _mm_add_ps(_mm_loadu_ps(channel_sums.data() + first), sum));
+#else
+        for (int channel = first; channel < first + count; channel++) {
+            float s_z1 = shelf_z1[channel], s_z2 = shelf_z2[channel];
+            float h_z1 = high_pass_z1[channel], h_z2 = high_pass_z2[channel];
+            float sum = 0.0f;
+            for (size_t frame = 0; frame < num_frames; frame++) {
+                float x = interleaved[frame * channels + channel];
+                float y = shelf.b0 * x + s_z1;
+                s_z1 = shelf.b1 * x - shelf.a1 * y + s_z2;
+                s_z2 = shelf.b2 * x - shelf.a2 * y;
+                x = y;
+                y = x + h_z1;
+                h_z1 = h_z2 - 2.0f * x - high_pass.a1 * y;
+                h_z2 = x - high_pass.a2 * y;
+                sum += y * y;
+            }
+            shelf_z1[channel] = s_z1;
+            shelf_z2[channel] = s_z2;
+            high_pass_z1[channel] = h_z1;
+            high_pass_z2[channel] = h_z2;
+            channel_sums[channel] += sum;
+        }
+#endif
+    }
+}
+
+double LoudnessMeter::get_channel_sums_energy(size_t num_frames) const {
+    double energy = 0.0;
+    for (int channel = 0; channel < channels; channel++) {
+        energy += channel_weights[channel] * (double)channel_sums[channel];
+    }
+    return energy / (double)num_frames;
+}
+
+float LoudnessMeter::get_integrated_loudness() const {
+    // each 400ms block is four 100ms sub blocks, so the blocks overlap by 75%
+    std::vector<double> blocks;
+    size_t num_sub_blocks = sub_block_energies.size();
+    if (num_sub_blocks >= 4) {
+        for (size_t i = 0; i + 4 <= num_sub_blocks; i++) {
+            blocks.push_back((sub_block_energies[i] + sub_block_energies[i + 1] + sub_block_energies[i + 2] +
+                              sub_block_energies[i + 3]) /
+                             4.0);
+        }
+    } else if (num_sub_blocks > 0 || frames_in_sub_block > 0) {
+        // too short for a whole block, so everything there is makes up one
+        double energy = 0.0;
+        for (double sub_block_energy : sub_block_energies) {
+            energy += sub_block_energy * (double)sub_block_frames;
+        }
+        if (frames_in_sub_block > 0) {
+            energy += get_channel_sums_energy(frames_in_sub_block) * (double)frames_in_sub_block;
+        }
+        blocks.push_back(energy / (double)(num_sub_blocks * sub_block_frames + frames_in_sub_block));
+    }
+
+    auto gated_mean = [&](double threshold) {
+        double sum = 0.0;
+        size_t count = 0;
+        for (double block : blocks) {
+            if (block > threshold) {
+                sum += block;
+                count++;
+            }
+        }
+        return count > 0 ? sum / (double)count : 0.0;
+    };
+
+    double absolute_gate = loudness_to_energy(-70.0);
+    double ungated = gated_mean(absolute_gate);
+    if (ungated <= 0.0) {
+        return unmeasured_loudness;
+    }
+    double relative_gate = loudness_to_energy(energy_to_loudness(ungated) - 10.0);
+    return (float)energy_to_loudness(gated_mean(std::max(absolute_gate, relative_gate)));
+}
+
+LoudnessEnvelope LoudnessMeter::get_loudness_envelope() const {
+    LoudnessEnvelope envelope;
+    envelope.block_frames = sub_block_frames;
+    auto energy_to_gain = [](double energy) { return (float)std::sqrt(energy / loudness_to_energy(0.0)); };
+    for (double sub_block_energy : sub_block_energies) {
+        envelope.block_gains.push_back(energy_to_gain(sub_block_energy));
+    }
+    if (frames_in_sub_block > 0) {
+        envelope.block_gains.push_back(energy_to_gain(get_channel_sums_energy(frames_in_sub_block)));
+    }
+    return envelope;
+}
+
+float LoudnessEnvelope::get_gain(size_t frame) const {
+    size_t block = frame / block_frames;
+    return block < block_gains.size() ? block_gains[block] : 0.0f;
+}
+
+float get_loudness_gain(float loudness) {
+    return std::isfinite(loudness) ? std::pow(10.0f, loudness / 20.0f) : 1.0f;
+}
+
+float get_loudness_trim(float loudness, float target_loudness, float max_boost_db) {
+    if (!std::isfinite(loudness)) {
+        return 1.0f;
+    }
+    float trim_db = std::min(target_loudness - loudness, max_boost_db);
+    return std::pow(10.0f, trim_db / 20.0f);
+}
@@ -0,0 +1,80 @@
+#ifndef LOUDNESS_HPP
+#define LOUDNESS_HPP
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// what silence and sounds which couldn't be measured read as, in LUFS
+constexpr float unmeasured_loudness = -std::numeric_limits<float>::infinity();
+// EBU R128's programme target in LUFS, what sounds are normalized to unless the game picks another
+constexpr float default_loudness_target = -23.0f;
+
+/**
+ * How loud a sound is along its length as a linear gain per 100ms, so something like ducking can follow a sound's
+ * loud and quiet parts rather than taking its integrated loudness the whole time it plays
+ */
+struct LoudnessEnvelope {
+    std::vector<float> block_gains;
+    size_t block_frames = 1;
+
+    bool empty() const { return block_gains.empty(); }
+    // @return the gain of the block the frame is in, 0 past the end
+    float get_gain(size_t frame) const;
+};
+
+/**
+ * Measures the integrated loudness of a sound as EBU R128 (ITU-R BS.1770) does: K-weighting, 400ms blocks overlapping
+ * by 75% and the absolute and relative gates. Sounds shorter than a block are measured as one block.
+ *
+ * The filters run on up to four channels at once with SSE, each channel in its own lane.
+ */
+class LoudnessMeter {
+  public:
+    LoudnessMeter(int channels, int sample_rate);
+
+    void add_frames(const float *interleaved, size_t num_frames);
+    // the samples are converted to float a chunk at a time
+    void add_frames(const short *interleaved, size_t num_frames);
+
+    // @return LUFS, unmeasured_loudness if every block was below the absolute gate
+    float get_integrated_loudness() const;
+    // the gain of each 100ms measured so far, scaled as get_loudness_gain scales the integrated loudness
+    LoudnessEnvelope get_loudness_envelope() const;
+
+  private:
+    struct Biquad {
+        float b0, b1, b2, a1, a2;
+    };
+
+    int channels;
+    int padded_channels; // rounded up to a whole number of lanes
+    Biquad shelf;        // the head's high frequency boost
+    Biquad high_pass;    // revised low-frequency B-curve
+    // four rows of padded_channels: the shelf's two delays then the high pass's
+    std::vector<float> filter_state;
+    std::vector<float> channel_weights;
+    std::vector<float> channel_sums; // the squared filtered samples of the current 100ms
+    size_t sub_block_frames;
+    size_t frames_in_sub_block = 0;
+    std::vector<double> sub_block_energies; // weighted mean square of each whole 100ms
+    std::vector<float> conversion;
+
+    void filter(const float *interleaved, size_t num_frames);
+    double get_channel_sums_energy(size_t num_frames) const;
+};
+
+/**
+ * The linear gain a sound of this loudness counts as, 0 LUFS is roughly a full scale sine which counts as 1
+ * @return 1 for unmeasured sounds, they're assumed to be full scale
+ */
+float get_loudness_gain(float loudness);
+
+/**
+ * The gain which brings a sound of the given loudness to the target, boosts are capped so that a quiet sound's noise
+ * floor isn't brought up with it
+ * @return 1 for unmeasured sounds
+ */
+float get_loudness_trim(float loudness, float target_loudness, float max_boost_db = 12.0f);
+
+#endif // LOUDNESS_HPP
@@ -0,0 +1,74 @@
+#include "mixer_bus.hpp"
+
+#include <cassert>
+#include <cmath>
+
+BusGraph::BusGraph() {
+    Node master;
+    master.parent = buses::master;
+    nodes.push_back(master);
+    create_bus(buses::master); // music
+    create_bus(buses::master); // sfx
+    create_bus(buses::master); // voice
+}
+
+BusId BusGraph::create_bus(BusId parent) {
+    assert(parent < nodes.size());
+    Node node;
+    node.parent = parent;
+    node.effective_gain = nodes[parent].effective_gain;
+    nodes.push_back(node);
+    return (BusId)nodes.size() - 1;
+}
+
+void BusGraph::set_gain(BusId bus, float gain) {
+    assert(bus < nodes.size() && gain >= 0);
+    Node &node = nodes[bus];
+    if (node.gain == gain) {
+        return;
+    }
+    node.gain = gain;
+    node.dirty = true;
+    any_dirty = true;
+}
+
+float BusGraph::get_gain(BusId bus) const { return nodes[bus].gain; }
+
+void BusGraph::set_duck_gain(BusId bus, float duck_gain, float epsilon) {
+    assert(bus < nodes.size() && duck_gain >= 0);
+    Node &node = nodes[bus];
+    bool fully_restored = duck_gain == 1.0f && node.duck_gain != 1.0f;
+    if (std::fabs(node.duck_gain - duck_gain) <= epsilon && !fully_restored) {
+        return;
+    }
+    node.duck_gain = duck_gain;
+    node.dirty = true;
+    any_dirty = true;
+}
+
+BusId BusGraph::get_parent(BusId bus) const { return nodes[bus].parent; }
+
+float BusGraph::get_effective_gain(BusId bus) const { return nodes[bus].effective_gain; }
+
+size_t BusGraph::get_bus_count() const { return nodes.size(); }
+
+void BusGraph::add_voice(BusId bus, uint32_t voice) {
+    assert(bus < nodes.size());
+    if (voice >= voice_slots.size()) {
+        voice_slots.resize(voice + 1);
+    }
+    voice_slots[voice] = (uint32_t)nodes[bus].voices.size();
+    nodes[bus].voices.push_back(voice);
+}
+
+void BusGraph::remove_voice(BusId bus, uint32_t voice) {
+    std::vector<uint32_t> &voices = nodes[bus].voices;
+    uint32_t slot = voice_slots[voice];
+    assert(slot < voices.size() && voices[slot] == voice);
+    uint32_t moved_voice = voices.back();
+    voices[slot] = moved_voice;
+    voice_slots[moved_voice] = slot;
+    voices.pop_back();
+}
+
+const std::vector<uint32_t> &BusGraph::get_voices(BusId bus) const { return nodes[bus].voices; }
@@ -0,0 +1,84 @@
+#ifndef MIXER_BUS_HPP
+#define MIXER_BUS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using BusId = uint32_t;
+
+// the buses every graph starts out with, everything else hangs off of master
+namespace buses {
+constexpr BusId master = 0;
+constexpr BusId music = 1;
+constexpr BusId sfx = 2;
+constexpr BusId voice = 3;
+} // namespace buses
+
+/**
+ * A tree of buses, each voice belongs to one bus and its gain is scaled by the gains of every bus on the way up to
+ * master. Gain changes only mark the bus dirty, the effective gains are worked out once per frame in propagate and only
+ * the voices under a bus which actually changed are visited.
+ */
+class BusGraph {
+  public:
+    BusGraph();
+
+    // buses have to be created after their parent, so iterating in id order visits parents first
+    BusId create_bus(BusId parent);
+    void set_gain(BusId bus, float gain);
+    float get_gain(BusId bus) const;
+    /**
+     * A second gain stage driven by ducking rather than by the user, changes smaller than the epsilon are ignored so
+     * that a settled envelope doesn't keep the bus dirty
+     */
+    void set_duck_gain(BusId bus, float duck_gain, float epsilon = 1e-3f);
+    BusId get_parent(BusId bus) const;
+    // the product of the gains from this bus up to master, as of the last propagate
+    float get_effective_gain(BusId bus) const;
+    size_t get_bus_count() const;
+
+    void add_voice(BusId bus, uint32_t voice);
+    void remove_voice(BusId bus, uint32_t voice);
+    const std::vector<uint32_t> &get_voices(BusId bus) const;
+
+    /**
+     * Recomputes the effective gain of every dirty bus and its descendants
+     * @param on_bus_changed called with each bus whose effective gain was recomputed
+     */
+    template <typename OnBusChanged> void propagate(OnBusChanged &&on_bus_changed) {
+        if (!any_dirty) {
+            return;
+        }
+        for (BusId bus = 0; bus < nodes.size(); bus++) {
+            Node &node = nodes[bus];
+            bool parent_changed = bus != buses::master && nodes[node.parent].changed_this_pass;
+            node.changed_this_pass = node.dirty || parent_changed;
+            if (!node.changed_this_pass) {
+                continue;
+            }
+            float parent_gain = bus == buses::master ? 1.0f : nodes[node.parent].effective_gain;
+            node.effective_gain = parent_gain * node.gain * node.duck_gain;
+            node.dirty = false;
+            on_bus_changed(bus);
+        }
+        any_dirty = false;
+    }
+
+  private:
+    struct Node {
+        BusId parent;
+        float gain = 1.0f;
+        float duck_gain = 1.0f;
+        float effective_gain = 1.0f;
+        bool dirty = false;
+        bool changed_this_pass = false;
+        std::vector<uint32_t> voices;
+    };
+    std::vector<Node> nodes;
+    // where each voice sits in its bus's voice list, so it can be removed in constant time
+    std::vector<uint32_t> voice_slots;
+    bool any_dirty = false;
+};
+
+#endif // MIXER_BUS_HPP
@@ -0,0 +1,28 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+#include <functional>
+#include <span>
+#include <glm/glm.hpp>
+
+// a line of sight check between the listener and an emitter
+struct OcclusionRay {
+    glm::vec3 from;
+    glm::vec3 to;
+};
+
+/**
+ * Provided by the game, it casts every ray against its own geometry and writes how blocked each one is, 0 for a clear
+ * line of sight up to 1 for fully blocked
+ */
+using OcclusionQuery = std::function<void(std::span<const OcclusionRay> rays, std::span<float> occlusion)>;
+
+struct OcclusionSettings {
+    // the most rays handed to the query per frame, voices take turns so the cost doesn't grow with the voice count
+    int rays_per_frame = 16;
+    // how much of the overall and high frequency gain is removed at full occlusion
+    float max_gain_reduction = 0.4f;
+    float max_high_frequency_reduction = 0.9f;
+};
+
+#endif // OCCLUSION_HPP
@@ -0,0 +1,169 @@
+#include "offline_render.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OFFLINE_RENDER_SSE
+#endif
+
+namespace {
+
+constexpr int chunk_frames = 4096;
+
+SoundFileHandle open_render(const std::string &path, SF_INFO &info) {
+    SoundFileHandle sound_file(sf_open(path.c_str(), SFM_READ, &info));
+    if (!sound_file) {
+        fprintf(stderr, "Could not open render %s: %s\n", path.c_str(), sf_strerror(NULL));
+        throw std::runtime_error("couldn't open the render " + path);
+    }
+    return sound_file;
+}
+
+/**
+ * Finds the samples which differ by more than the tolerance, four at a time with SSE
+ * @param first_mismatch set to the index of the first one if it's still unset, ie SIZE_MAX
+ * @return how many there are
+ */
+int64_t compare_samples(const float *render, const float *golden, size_t count, float tolerance,
+                        float &max_difference, size_t &first_mismatch) {
+    int64_t num_mismatched = 0;
+    size_t i = 0;
+#ifdef OFFLINE_RENDER_SSE
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 tolerance_ps = _mm_set1_ps(tolerance);
+    __m128 max_ps = _mm_set1_ps(max_difference);
+    for (; i + 4 <= count; i += 4) {
+        __m128 difference = _mm_andnot_ps(sign_mask, _mm_sub_ps(_mm_loadu_ps(render + i), _mm_loadu_ps(golden + i)));
+        max_ps = _mm_max_ps(max_ps, difference);
+        // not less or equal, so that NaNs count as mismatches
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_cmpnle_ps(difference, tolerance_ps));
+        if (mask != 0) {
+            num_mismatched += std::popcount(mask);
+            if (first_mismatch == SIZE_MAX) {
+                first_mismatch = i + std::countr_zero(mask);
+            }
+        }
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, max_ps);
+    max_difference = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < count; i++) {
+        float difference = std::fabs(render[i] - golden[i]);
+        max_difference = std::max(max_difference, difference);
+        if (!(difference <= tolerance)) {
+            num_mismatched++;
+            if (first_mismatch == SIZE_MAX) {
+                first_mismatch = i;
+            }
+        }
+    }
+    return num_mismatched;
+}
+
+} // namespace
+
+OfflineRenderer::OfflineRenderer(SoundSystem &sound_system, const std::string &path, int sndfile_format)
+    : sound_system(sound_system), path(path) {
+    if (!sound_system.is_loopback()) {
+        throw std::runtime_error("only a system made with a loopback format can be rendered offline");
+    }
+    const LoopbackFormat &format = sound_system.get_loopback_format();
+    SF_INFO info{};
+    info.samplerate = format.sample_rate;
+    info.channels = format.channels;
+    info.format = sndfile_format;
+    if (!sf_format_check(&info)) {
+        throw std::runtime_error("libsndfile can't write the format asked for " + path);
+    }
+    sound_file.reset(sf_open(path.c_str(), SFM_WRITE, &info));
+    if (!sound_file) {
+        fprintf(stderr, "Could not open %s for writing: %s\n", path.c_str(), sf_strerror(NULL));
+        throw std::runtime_error("couldn't open " + path + " for writing");
+    }
+    chunk.resize((size_t)chunk_frames * format.channels);
+}
+
+void OfflineRenderer::render_frames(int64_t num_frames) {
+    if (!sound_file) {
+        throw std::runtime_error("the offline render " + path + " was already closed");
+    }
+    using clock = std::chrono::steady_clock;
+    while (num_frames > 0) {
+        int frames = (int)std::min<int64_t>(num_frames, chunk_frames);
+        clock::time_point mix_start = clock::now();
+        sound_system.render_loopback(chunk.data(), frames);
+        mix_seconds += std::chrono::duration<double>(clock::now() - mix_start).count();
+
+        if (sf_writef_float(sound_file.get(), chunk.data(), frames) != frames) {
+            fprintf(stderr, "Could not write to %s: %s\n", path.c_str(), sf_strerror(sound_file.get()));
+            throw std::runtime_error("failed to write the offline render " + path);
+        }
+        rendered_frames += frames;
+        num_frames -= frames;
+    }
+}
+
+void OfflineRenderer::render_seconds(double seconds) {
+    render_frames((int64_t)std::llround(seconds * sound_system.get_loopback_format().sample_rate));
+}
+
+double OfflineRenderer::get_rendered_seconds() const {
+    return (double)rendered_frames / sound_system.get_loopback_format().sample_rate;
+}
+
+double OfflineRenderer::get_mix_seconds() const { return mix_seconds; }
+
+double OfflineRenderer::get_realtime_factor() const {
+    return mix_seconds > 0.0 ? get_rendered_seconds() / mix_seconds : 0.0;
+}
+
+void OfflineRenderer::close() { sound_file.reset(); }
+
+RenderComparison compare_renders(const std::string &render_path, const std::string &golden_path, float tolerance) {
+    SF_INFO render_info{};
+    SF_INFO golden_info{};
+    SoundFileHandle render = open_render(render_path, render_info);
+    SoundFileHandle golden = open_render(golden_path, golden_info);
+
+    RenderComparison comparison;
+    comparison.frames = render_info.frames;
+    comparison.golden_frames = golden_info.frames;
+    comparison.formats_match =
+        render_info.channels == golden_info.channels && render_info.samplerate == golden_info.samplerate;
+    if (!comparison.formats_match) {
+        return comparison;
+    }
+
+    int channels = render_info.channels;
+    std::vector<float> render_chunk((size_t)chunk_frames * channels);
+    std::vector<float> golden_chunk((size_t)chunk_frames * channels);
+    int64_t frame = 0;
+    while (true) {
+        sf_count_t render_frames = sf_readf_float(render.get(), render_chunk.data(), chunk_frames);
+        sf_count_t golden_frames = sf_readf_float(golden.get(), golden_chunk.data(), chunk_frames);
+        sf_count_t frames = std::min(render_frames, golden_frames);
+        if (frames <= 0) {
+            break;
+        }
+        size_t first_mismatch = SIZE_MAX;
+        comparison.num_mismatched_samples += compare_samples(render_chunk.data(), golden_chunk.data(),
+                                                             (size_t)frames * channels, tolerance,
+                                                             comparison.max_difference, first_mismatch);
+        if (first_mismatch != SIZE_MAX && comparison.first_mismatch_frame < 0) {
+            comparison.first_mismatch_frame = frame + (int64_t)(first_mismatch / channels);
+        }
+        frame += frames;
+    }
+
+    if (comparison.first_mismatch_frame < 0 && comparison.frames != comparison.golden_frames) {
+        comparison.first_mismatch_frame = frame; // where the shorter one ran out
+    }
+    comparison.matches = comparison.num_mismatched_samples == 0 && comparison.frames == comparison.golden_frames;
+    return comparison;
+}
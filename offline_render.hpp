@@ -0,0 +1,65 @@
+#ifndef OFFLINE_RENDER_HPP
+#define OFFLINE_RENDER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "load_sound_file.hpp"
+#include "sound_system.hpp"
+
+/**
+ * Writes the mix of a loopback system to a sound file, rendering as fast as the cpu allows rather than in real time,
+ * so runs of the game or of a replayed trace can be checked on machines without an audio device
+ */
+class OfflineRenderer {
+  public:
+    /**
+     * @param sndfile_format libsndfile's major and sub format, float wavs keep the mix exactly as rendered
+     * @throw std::runtime_error if the system isn't a loopback one or the file can't be opened
+     */
+    OfflineRenderer(SoundSystem &sound_system, const std::string &path,
+                    int sndfile_format = SF_FORMAT_WAV | SF_FORMAT_FLOAT);
+
+    void render_frames(int64_t num_frames);
+    void render_seconds(double seconds);
+
+    double get_rendered_seconds() const;
+    // wall time spent mixing, writing the file isn't counted
+    double get_mix_seconds() const;
+    // seconds of audio mixed per wall second, above 1 is faster than real time
+    double get_realtime_factor() const;
+
+    // flushes the file, nothing more can be rendered afterwards
+    void close();
+
+  private:
+    SoundSystem &sound_system;
+    SoundFileHandle sound_file;
+    std::string path;
+    std::vector<float> chunk;
+    int64_t rendered_frames = 0;
+    double mix_seconds = 0.0;
+};
+
+// how a render differs from a golden file, samples match if they're within the tolerance of each other
+struct RenderComparison {
+    bool matches = false;
+    bool formats_match = false; // channels and sample rate
+    int64_t frames = 0;         // of the render
+    int64_t golden_frames = 0;
+    int64_t first_mismatch_frame = -1;
+    int64_t num_mismatched_samples = 0;
+    float max_difference = 0.0f;
+};
+
+/**
+ * Compares two renders sample by sample, a render which is longer or shorter than the golden file doesn't match
+ * @param tolerance the largest difference between two samples which still counts as the same, the default allows for
+ * rounding differences between compilers and cpus
+ * @throw std::runtime_error if either file can't be opened
+ */
+RenderComparison compare_renders(const std::string &render_path, const std::string &golden_path,
+                                 float tolerance = 1e-4f);
+
+#endif // OFFLINE_RENDER_HPP
@@ -0,0 +1,94 @@
+#include "openal_extensions.hpp"
+
+#include <stdexcept>
+
+OpenALExtensions load_openal_device_extensions(ALCdevice *device) {
+    OpenALExtensions extensions;
+
+    if (alcIsExtensionPresent(device, "ALC_SOFT_device_clock")) {
+        extensions.alcGetInteger64vSOFT =
+            reinterpret_cast<LPALCGETINTEGER64VSOFT>(alcGetProcAddress(device, "alcGetInteger64vSOFT"));
+    }
+
+    if (alcIsExtensionPresent(device, "ALC_EXT_thread_local_context")) {
+        extensions.alcSetThreadContext =
+            reinterpret_cast<PFNALCSETTHREADCONTEXTPROC>(alcGetProcAddress(device, "alcSetThreadContext"));
+        extensions.alcGetThreadContext =
+            reinterpret_cast<PFNALCGETTHREADCONTEXTPROC>(alcGetProcAddress(device, "alcGetThreadContext"));
+    }
+
+    return extensions;
+}
+
+bool load_openal_loopback_extension(OpenALExtensions &extensions) {
+    if (!alcIsExtensionPresent(NULL, "ALC_SOFT_loopback")) {
+        return false;
+    }
+    extensions.alcLoopbackOpenDeviceSOFT =
+        reinterpret_cast<LPALCLOOPBACKOPENDEVICESOFT>(alcGetProcAddress(NULL, "alcLoopbackOpenDeviceSOFT"));
+    extensions.alcIsRenderFormatSupportedSOFT =
+        reinterpret_cast<LPALCISRENDERFORMATSUPPORTEDSOFT>(alcGetProcAddress(NULL, "alcIsRenderFormatSupportedSOFT"));
+    extensions.alcRenderSamplesSOFT =
+        reinterpret_cast<LPALCRENDERSAMPLESSOFT>(alcGetProcAddress(NULL, "alcRenderSamplesSOFT"));
+    return extensions.alcLoopbackOpenDeviceSOFT && extensions.alcIsRenderFormatSupportedSOFT &&
+           extensions.alcRenderSamplesSOFT;
+}
+
+void load_openal_context_extensions(ALCdevice *device, OpenALExtensions &extensions) {
+    if (alIsExtensionPresent("AL_SOFT_deferred_updates")) {
+        extensions.alDeferUpdatesSOFT = reinterpret_cast<LPALDEFERUPDATESSOFT>(alGetProcAddress("alDeferUpdatesSOFT"));
+        extensions.alProcessUpdatesSOFT =
+            reinterpret_cast<LPALPROCESSUPDATESSOFT>(alGetProcAddress("alProcessUpdatesSOFT"));
+    }
+
+    if (alIsExtensionPresent("AL_SOFT_source_start_delay")) {
+        extensions.alSourcePlayAtTimeSOFT =
+            reinterpret_cast<LPALSOURCEPLAYATTIMESOFT>(alGetProcAddress("alSourcePlayAtTimeSOFT"));
+    }
+
+    extensions.source_distance_model = alIsExtensionPresent("AL_EXT_source_distance_model");
+
+    if (alIsExtensionPresent("AL_SOFT_callback_buffer")) {
+        extensions.alBufferCallbackSOFT =
+            reinterpret_cast<LPALBUFFERCALLBACKSOFT>(alGetProcAddress("alBufferCallbackSOFT"));
+    }
+
+    if (alcIsExtensionPresent(device, "ALC_EXT_EFX")) {
+        extensions.efx = true;
+        extensions.alGenEffects = reinterpret_cast<LPALGENEFFECTS>(alGetProcAddress("alGenEffects"));
+        extensions.alDeleteEffects = reinterpret_cast<LPALDELETEEFFECTS>(alGetProcAddress("alDeleteEffects"));
+        extensions.alEffecti = reinterpret_cast<LPALEFFECTI>(alGetProcAddress("alEffecti"));
+        extensions.alEffectf = reinterpret_cast<LPALEFFECTF>(alGetProcAddress("alEffectf"));
+        extensions.alEffectfv = reinterpret_cast<LPALEFFECTFV>(alGetProcAddress("alEffectfv"));
+        extensions.alGenFilters = reinterpret_cast<LPALGENFILTERS>(alGetProcAddress("alGenFilters"));
+        extensions.alDeleteFilters = reinterpret_cast<LPALDELETEFILTERS>(alGetProcAddress("alDeleteFilters"));
+        extensions.alFilteri = reinterpret_cast<LPALFILTERI>(alGetProcAddress("alFilteri"));
+        extensions.alFilterf = reinterpret_cast<LPALFILTERF>(alGetProcAddress("alFilterf"));
+        extensions.alGenAuxiliaryEffectSlots =
+            reinterpret_cast<LPALGENAUXILIARYEFFECTSLOTS>(alGetProcAddress("alGenAuxiliaryEffectSlots"));
+        extensions.alDeleteAuxiliaryEffectSlots =
+            reinterpret_cast<LPALDELETEAUXILIARYEFFECTSLOTS>(alGetProcAddress("alDeleteAuxiliaryEffectSlots"));
+        extensions.alAuxiliaryEffectSloti =
+            reinterpret_cast<LPALAUXILIARYEFFECTSLOTI>(alGetProcAddress("alAuxiliaryEffectSloti"));
+        extensions.alAuxiliaryEffectSlotf =
+            reinterpret_cast<LPALAUXILIARYEFFECTSLOTF>(alGetProcAddress("alAuxiliaryEffectSlotf"));
+    }
+}
+
+bool bind_context(const OpenALExtensions &extensions, ALCcontext *context) {
+    if (extensions.alcSetThreadContext) {
+        return extensions.alcGetThreadContext() == context || extensions.alcSetThreadContext(context);
+    }
+    return alcGetCurrentContext() == context || alcMakeContextCurrent(context);
+}
+
+ThreadContextBinding::ThreadContextBinding(const OpenALExtensions &extensions, ALCcontext *context)
+    : extensions(extensions) {
+    if (!extensions.alcSetThreadContext) {
+        throw std::runtime_error("binding a context to a thread needs ALC_EXT_thread_local_context");
+    }
+    previous_context = extensions.alcGetThreadContext();
+    extensions.alcSetThreadContext(context);
+}
+
+ThreadContextBinding::~ThreadContextBinding() { extensions.alcSetThreadContext(previous_context); }
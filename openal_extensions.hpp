@@ -0,0 +1,92 @@
+#ifndef OPENAL_EXTENSIONS_HPP
+#define OPENAL_EXTENSIONS_HPP
+
+#include <AL/al.h>
+#include <AL/alc.h>
+#include <AL/alext.h>
+#include <AL/efx.h>
+
+/**
+ * Function pointers for the OpenAL Soft extensions the sound system uses, a null pointer means the extension is not
+ * present on the device and the caller has to fall back to the core api.
+ */
+struct OpenALExtensions {
+    // ALC_SOFT_device_clock
+    LPALCGETINTEGER64VSOFT alcGetInteger64vSOFT = nullptr;
+    // ALC_EXT_thread_local_context
+    PFNALCSETTHREADCONTEXTPROC alcSetThreadContext = nullptr;
+    PFNALCGETTHREADCONTEXTPROC alcGetThreadContext = nullptr;
+    // AL_SOFT_deferred_updates
+    LPALDEFERUPDATESSOFT alDeferUpdatesSOFT = nullptr;
+    LPALPROCESSUPDATESSOFT alProcessUpdatesSOFT = nullptr;
+    // AL_SOFT_source_start_delay
+    LPALSOURCEPLAYATTIMESOFT alSourcePlayAtTimeSOFT = nullptr;
+    // AL_EXT_source_distance_model, lets each source pick its own distance model once enabled
+    bool source_distance_model = false;
+    // AL_SOFT_callback_buffer
+    LPALBUFFERCALLBACKSOFT alBufferCallbackSOFT = nullptr;
+    // ALC_SOFT_loopback, see load_openal_loopback_extension
+    LPALCLOOPBACKOPENDEVICESOFT alcLoopbackOpenDeviceSOFT = nullptr;
+    LPALCISRENDERFORMATSUPPORTEDSOFT alcIsRenderFormatSupportedSOFT = nullptr;
+    LPALCRENDERSAMPLESSOFT alcRenderSamplesSOFT = nullptr;
+    // ALC_EXT_EFX
+    bool efx = false;
+    LPALGENEFFECTS alGenEffects = nullptr;
+    LPALDELETEEFFECTS alDeleteEffects = nullptr;
+    LPALEFFECTI alEffecti = nullptr;
+    LPALEFFECTF alEffectf = nullptr;
+    LPALEFFECTFV alEffectfv = nullptr;
+    LPALGENFILTERS alGenFilters = nullptr;
+    LPALDELETEFILTERS alDeleteFilters = nullptr;
+    LPALFILTERI alFilteri = nullptr;
+    LPALFILTERF alFilterf = nullptr;
+    LPALGENAUXILIARYEFFECTSLOTS alGenAuxiliaryEffectSlots = nullptr;
+    LPALDELETEAUXILIARYEFFECTSLOTS alDeleteAuxiliaryEffectSlots = nullptr;
+    LPALAUXILIARYEFFECTSLOTI alAuxiliaryEffectSloti = nullptr;
+    LPALAUXILIARYEFFECTSLOTF alAuxiliaryEffectSlotf = nullptr;
+};
+
+/**
+ * Looks up the ALC extension functions, these only need the device so they can be used to make the first context
+ * current.
+ */
+OpenALExtensions load_openal_device_extensions(ALCdevice *device);
+
+/**
+ * Looks up the ALC_SOFT_loopback functions, unlike the other extensions these are needed before there is a device
+ * since they open one
+ * @return false if the extension isn't present
+ */
+bool load_openal_loopback_extension(OpenALExtensions &extensions);
+
+/**
+ * Looks up the AL extension functions, must be called once a context on the device is current.
+ */
+void load_openal_context_extensions(ALCdevice *device, OpenALExtensions &extensions);
+
+/**
+ * Makes the context current for the calling thread if it isn't already, only touching this thread when
+ * ALC_EXT_thread_local_context is present and falling back to the process wide current context otherwise.
+ * @return false if the context couldn't be made current
+ */
+bool bind_context(const OpenALExtensions &extensions, ALCcontext *context);
+
+/**
+ * Makes a context current on the calling thread only for as long as it lives, restoring whatever was current before,
+ * this is how worker threads get to use a context without disturbing any other thread. Needs
+ * ALC_EXT_thread_local_context.
+ */
+class ThreadContextBinding {
+  public:
+    ThreadContextBinding(const OpenALExtensions &extensions, ALCcontext *context);
+    ~ThreadContextBinding();
+
+    ThreadContextBinding(const ThreadContextBinding &) = delete;
+    ThreadContextBinding &operator=(const ThreadContextBinding &) = delete;
+
+  private:
+    const OpenALExtensions &extensions;
+    ALCcontext *previous_context;
+};
+
+#endif // OPENAL_EXTENSIONS_HPP
@@ -0,0 +1,119 @@
+#include "procedural_audio.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PROCEDURAL_AUDIO_SSE
+#endif
+
+NoiseGenerator::NoiseGenerator(uint32_t seed) {
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        state[lane] = seed ^ ((lane + 1) * 0x85ebca6bu);
+        // xorshift gets stuck at zero
+        if (state[lane] == 0) {
+            state[lane] = lane + 1;
+        }
+    }
+}
+
+static float wrap_phase(float phase) { return phase - (float)(int)phase; }
+
+// sin(2 pi phase) for a phase in [0, 1)
+static float approximate_sine(float phase) {
+    float u = phase - 0.5f;
+    float abs_u = u < 0 ? -u : u;
+    float s = 8.0f * u - 16.0f * u * abs_u;
+    float abs_s = s < 0 ? -s : s;
+    return -(0.225f * (s * abs_s - s) + s);
+}
+
+#ifdef PROCEDURAL_AUDIO_SSE
+static __m128 wrap_phase(__m128 phase) {
+    // the phases are never negative so truncating is the same as flooring
+    return _mm_sub_ps(phase, _mm_cvtepi32_ps(_mm_cvttps_epi32(phase)));
+}
+
+static __m128 abs_ps(__m128 x) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), x); }
+
+static __m128 approximate_sine(__m128 phase) {
+    __m128 u = _mm_sub_ps(phase, _mm_set1_ps(0.5f));
+    __m128 s = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(8.0f), u), _mm_mul_ps(_mm_set1_ps(16.0f), _mm_mul_ps(u, abs_ps(u))));
+    __m128 refined = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.225f), _mm_sub_ps(_mm_mul_ps(s, abs_ps(s)), s)), s);
+    return _mm_sub_ps(_mm_setzero_ps(), refined);
+}
+
+// the phase of each of the next four samples
+static __m128 get_lane_phases(float phase, float step) {
+    return wrap_phase(_mm_add_ps(_mm_set1_ps(phase), _mm_mul_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(step))));
+}
+#endif
+
+void generate_sine(Oscillator &oscillator, int sample_rate, float *out, size_t count) {
+    float step = wrap_phase(oscillator.frequency / (float)sample_rate);
+    float phase = oscillator.phase;
+    size_t i = 0;
+#ifdef PROCEDURAL_AUDIO_SSE
+    if (count >= 4) {
+        __m128 phases = get_lane_phases(phase, step);
+        __m128 advance = _mm_set1_ps(4.0f * step);
+        __m128 amplitude = _mm_set1_ps(oscillator.amplitude);
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(out + i, _mm_mul_ps(approximate_sine(phases), amplitude));
+            phases = wrap_phase(_mm_add_ps(phases, advance));
+        }
+        phase = _mm_cvtss_f32(phases);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = approximate_sine(phase) * oscillator.amplitude;
+        phase = wrap_phase(phase + step);
+    }
+    oscillator.phase = phase;
+}
+
+void generate_saw(Oscillator &oscillator, int sample_rate, float *out, size_t count) {
+    float step = wrap_phase(oscillator.frequency / (float)sample_rate);
+    float phase = oscillator.phase;
+    size_t i = 0;
+#ifdef PROCEDURAL_AUDIO_SSE
+    if (count >= 4) {
+        __m128 phases = get_lane_phases(phase, step);
+        __m128 advance = _mm_set1_ps(4.0f * step);
+        __m128 scale = _mm_set1_ps(2.0f * oscillator.amplitude);
+        __m128 offset = _mm_set1_ps(oscillator.amplitude);
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(out + i, _mm_sub_ps(_mm_mul_ps(phases, scale), offset));
+            phases = wrap_phase(_mm_add_ps(phases, advance));
+        }
+        phase = _mm_cvtss_f32(phases);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = (2.0f * phase - 1.0f) * oscillator.amplitude;
+        phase = wrap_phase(phase + step);
+    }
+    oscillator.phase = phase;
+}
+
+void generate_white_noise(NoiseGenerator &noise, float *out, size_t count) {
+    // maps the full int32 range onto [-1, 1)
+    constexpr float int_to_float = 1.0f / 2147483648.0f;
+    size_t i = 0;
+#ifdef PROCEDURAL_AUDIO_SSE
+    __m128i state = _mm_loadu_si128((const __m128i *)noise.state);
+    __m128 scale = _mm_set1_ps(noise.amplitude * int_to_float);
+    for (; i + 4 <= count; i += 4) {
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(state), scale));
+    }
+    _mm_storeu_si128((__m128i *)noise.state, state);
+#endif
+    for (; i < count; i++) {
+        uint32_t &x = noise.state[i % 4];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        out[i] = (float)(int32_t)x * noise.amplitude * int_to_float;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef PROCEDURAL_AUDIO_HPP
+#define PROCEDURAL_AUDIO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * Fills mono float samples on demand, it's called from OpenAL's mixer thread so it must not block, allocate or touch
+ * the sound system.
+ * @return how many samples were written, writing fewer than asked for ends the sound
+ */
+using SampleGenerator = std::function<size_t(float *samples, size_t count)>;
+
+// phase is in cycles, so it wraps at 1
+struct Oscillator {
+    float frequency = 440.0f;
+    float amplitude = 1.0f;
+    float phase = 0.0f;
+};
+
+// a xorshift generator per simd lane
+struct NoiseGenerator {
+    explicit NoiseGenerator(uint32_t seed = 0x9e3779b9u);
+
+    float amplitude = 1.0f;
+    uint32_t state[4];
+};
+
+/*
+ * The helpers below write count samples and carry their state over to the next call, so a generator can call them once
+ * per callback. The sine is a parabolic approximation which is within about 0.2% of the real one.
+ */
+void generate_sine(Oscillator &oscillator, int sample_rate, float *out, size_t count);
+void generate_saw(Oscillator &oscillator, int sample_rate, float *out, size_t count);
+void generate_white_noise(NoiseGenerator &noise, float *out, size_t count);
+
+#endif // PROCEDURAL_AUDIO_HPP
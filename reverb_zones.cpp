@@ -0,0 +1,191 @@
+#include "reverb_zones.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+ReverbZone ReverbZone::box(glm::vec3 min, glm::vec3 max, const EFXEAXREVERBPROPERTIES &preset) {
+    ReverbZone zone;
+    zone.shape = Shape::box;
+    zone.min = min;
+    zone.max = max;
+    zone.center = (min + max) * 0.5f;
+    zone.preset = preset;
+    return zone;
+}
+
+ReverbZone ReverbZone::sphere(glm::vec3 center, float radius, const EFXEAXREVERBPROPERTIES &preset) {
+    ReverbZone zone;
+    zone.shape = Shape::sphere;
+    zone.center = center;
+    zone.radius = radius;
+    zone.preset = preset;
+    return zone;
+}
+
+bool ReverbZone::contains(glm::vec3 point) const { return distance_to(point) == 0.0f; }
+
+float ReverbZone::distance_to(glm::vec3 point) const {
+    if (shape == Shape::sphere) {
+        glm::vec3 offset = point - center;
+        return std::max(0.0f, std::sqrt(glm::dot(offset, offset)) - radius);
+    }
+    glm::vec3 outside = glm::max(glm::max(min - point, point - max), glm::vec3(0.0f));
+    return std::sqrt(glm::dot(outside, outside));
+}
+
+ReverbZoneSystem::ReverbZoneSystem(const OpenALExtensions &extensions, int num_slots, int num_sends)
+    : extensions(extensions), num_sends(num_sends) {
+    assert(extensions.efx && num_slots > 0 && num_slots <= 64);
+    slots.resize(num_slots);
+    for (Slot &slot : slots) {
+        extensions.alGenAuxiliaryEffectSlots(1, &slot.effect_slot);
+        extensions.alGenEffects(1, &slot.effect);
+    }
+}
+
+ReverbZoneSystem::~ReverbZoneSystem() {
+    for (Slot &slot : slots) {
+        extensions.alDeleteAuxiliaryEffectSlots(1, &slot.effect_slot);
+        extensions.alDeleteEffects(1, &slot.effect);
+    }
+}
+
+ReverbZoneId ReverbZoneSystem::add_zone(const ReverbZone &zone) {
+    zones.push_back(zone);
+    listener_inside_zone.push_back(false);
+    assignment_stale = true;
+    return (ReverbZoneId)zones.size() - 1;
+}
+
+bool ReverbZoneSystem::update_listener(glm::vec3 listener_position) {
+    bool crossed_boundary = false;
+    for (size_t zone = 0; zone < zones.size(); zone++) {
+        bool inside = zones[zone].contains(listener_position);
+        if (inside != listener_inside_zone[zone]) {
+            listener_inside_zone[zone] = inside;
+            crossed_boundary = true;
+        }
+    }
+
+    if (!crossed_boundary && !assignment_stale) {
+        return false;
+    }
+    assign_slots(listener_position);
+    assignment_stale = false;
+    return true;
+}
+
+/**
+ * Gives the slots to the zones closest to the listener, zones which keep their slot aren't touched so their reverb
+ * tails carry on uninterrupted
+ */
+void ReverbZoneSystem::assign_slots(glm::vec3 listener_position) {
+    std::vector<int> ranked_zones(zones.size());
+    for (size_t zone = 0; zone < zones.size(); zone++) {
+        ranked_zones[zone] = (int)zone;
+    }
+    size_t num_wanted = std::min(slots.size(), zones.size());
+    std::partial_sort(ranked_zones.begin(), ranked_zones.begin() + num_wanted, ranked_zones.end(), [&](int a, int b) {
+        return zones[a].distance_to(listener_position) < zones[b].distance_to(listener_position);
+    });
+    ranked_zones.resize(num_wanted);
+
+    for (Slot &slot : slots) {
+        if (slot.zone != -1 && std::find(ranked_zones.begin(), ranked_zones.end(), slot.zone) == ranked_zones.end()) {
+            extensions.alAuxiliaryEffectSloti(slot.effect_slot, AL_EFFECTSLOT_EFFECT, AL_EFFECT_NULL);
+            slot.zone = -1;
+        }
+    }
+
+    for (int zone : ranked_zones) {
+        bool already_assigned =
+            std::any_of(slots.begin(), slots.end(), [&](const Slot &slot) { return slot.zone == zone; });
+        if (already_assigned) {
+            continue;
+        }
+        auto free_slot = std::find_if(slots.begin(), slots.end(), [](const Slot &slot) { return slot.zone == -1; });
+        assert(free_slot != slots.end());
+        load_preset(free_slot->effect, zones[zone].preset);
+        // the effect's properties are copied into the slot when it's attached
+        extensions.alAuxiliaryEffectSloti(free_slot->effect_slot, AL_EFFECTSLOT_EFFECT, (ALint)free_slot->effect);
+        free_slot->zone = zone;
+    }
+}
+
+void ReverbZoneSystem::route_source(ALuint source, glm::vec3 position, ALuint send_filter) const {
+    int send = 0;
+    uint64_t used_slots = 0;
+    for (; send < num_sends; send++) {
+        int nearest_slot = -1;
+        float nearest_distance = 0;
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (slots[i].zone == -1 || (used_slots >> i) & 1) {
+                continue;
+            }
+            float distance = zones[slots[i].zone].distance_to(position);
+            if (nearest_slot == -1 || distance < nearest_distance) {
+                nearest_slot = (int)i;
+                nearest_distance = distance;
+            }
+        }
+        if (nearest_slot == -1) {
+            break;
+        }
+        used_slots |= uint64_t(1) << nearest_slot;
+        alSource3i(source, AL_AUXILIARY_SEND_FILTER, (ALint)slots[nearest_slot].effect_slot, send, (ALint)send_filter);
+    }
+    for (; send < num_sends; send++) {
+        alSource3i(source, AL_AUXILIARY_SEND_FILTER, AL_EFFECTSLOT_NULL, send, AL_FILTER_NULL);
+    }
+}
+
+/**
+ * Loads the preset as an EAX reverb, falling back to the standard reverb which has a subset of the properties when
+ * EAX reverb isn't supported
+ */
+void ReverbZoneSystem::load_preset(ALuint effect, const EFXEAXREVERBPROPERTIES &preset) {
+    alGetError();
+    extensions.alEffecti(effect, AL_EFFECT_TYPE, AL_EFFECT_EAXREVERB);
+    if (alGetError() == AL_NO_ERROR) {
+        extensions.alEffectf(effect, AL_EAXREVERB_DENSITY, preset.flDensity);
+        extensions.alEffectf(effect, AL_EAXREVERB_DIFFUSION, preset.flDiffusion);
+        extensions.alEffectf(effect, AL_EAXREVERB_GAIN, preset.flGain);
+        extensions.alEffectf(effect, AL_EAXREVERB_GAINHF, preset.flGainHF);
+        extensions.alEffectf(effect, AL_EAXREVERB_GAINLF, preset.flGainLF);
+        extensions.alEffectf(effect, AL_EAXREVERB_DECAY_TIME, preset.flDecayTime);
+        extensions.alEffectf(effect, AL_EAXREVERB_DECAY_HFRATIO, preset.flDecayHFRatio);
+        extensions.alEffectf(effect, AL_EAXREVERB_DECAY_LFRATIO, preset.flDecayLFRatio);
+        extensions.alEffectf(effect, AL_EAXREVERB_REFLECTIONS_GAIN, preset.flReflectionsGain);
+        extensions.alEffectf(effect, AL_EAXREVERB_REFLECTIONS_DELAY, preset.flReflectionsDelay);
+        extensions.alEffectfv(effect, AL_EAXREVERB_REFLECTIONS_PAN, preset.flReflectionsPan);
+        extensions.alEffectf(effect, AL_EAXREVERB_LATE_REVERB_GAIN, preset.flLateReverbGain);
+        extensions.alEffectf(effect, AL_EAXREVERB_LATE_REVERB_DELAY, preset.flLateReverbDelay);
+        extensions.alEffectfv(effect, AL_EAXREVERB_LATE_REVERB_PAN, preset.flLateReverbPan);
+        extensions.alEffectf(effect, AL_EAXREVERB_ECHO_TIME, preset.flEchoTime);
+        extensions.alEffectf(effect, AL_EAXREVERB_ECHO_DEPTH, preset.flEchoDepth);
+        extensions.alEffectf(effect, AL_EAXREVERB_MODULATION_TIME, preset.flModulationTime);
+        extensions.alEffectf(effect, AL_EAXREVERB_MODULATION_DEPTH, preset.flModulationDepth);
+        extensions.alEffectf(effect, AL_EAXREVERB_AIR_ABSORPTION_GAINHF, preset.flAirAbsorptionGainHF);
+        extensions.alEffectf(effect, AL_EAXREVERB_HFREFERENCE, preset.flHFReference);
+        extensions.alEffectf(effect, AL_EAXREVERB_LFREFERENCE, preset.flLFReference);
+        extensions.alEffectf(effect, AL_EAXREVERB_ROOM_ROLLOFF_FACTOR, preset.flRoomRolloffFactor);
+        extensions.alEffecti(effect, AL_EAXREVERB_DECAY_HFLIMIT, preset.iDecayHFLimit);
+        return;
+    }
+
+    extensions.alEffecti(effect, AL_EFFECT_TYPE, AL_EFFECT_REVERB);
+    extensions.alEffectf(effect, AL_REVERB_DENSITY, preset.flDensity);
+    extensions.alEffectf(effect, AL_REVERB_DIFFUSION, preset.flDiffusion);
+    extensions.alEffectf(effect, AL_REVERB_GAIN, preset.flGain);
+    extensions.alEffectf(effect, AL_REVERB_GAINHF, preset.flGainHF);
+    extensions.alEffectf(effect, AL_REVERB_DECAY_TIME, preset.flDecayTime);
+    extensions.alEffectf(effect, AL_REVERB_DECAY_HFRATIO, preset.flDecayHFRatio);
+    extensions.alEffectf(effect, AL_REVERB_REFLECTIONS_GAIN, preset.flReflectionsGain);
+    extensions.alEffectf(effect, AL_REVERB_REFLECTIONS_DELAY, preset.flReflectionsDelay);
+    extensions.alEffectf(effect, AL_REVERB_LATE_REVERB_GAIN, preset.flLateReverbGain);
+    extensions.alEffectf(effect, AL_REVERB_LATE_REVERB_DELAY, preset.flLateReverbDelay);
+    extensions.alEffectf(effect, AL_REVERB_AIR_ABSORPTION_GAINHF, preset.flAirAbsorptionGainHF);
+    extensions.alEffectf(effect, AL_REVERB_ROOM_ROLLOFF_FACTOR, preset.flRoomRolloffFactor);
+    extensions.alEffecti(effect, AL_REVERB_DECAY_HFLIMIT, preset.iDecayHFLimit);
+}
@@ -0,0 +1,74 @@
+#ifndef REVERB_ZONES_HPP
+#define REVERB_ZONES_HPP
+
+#include <AL/al.h>
+#include <AL/efx-presets.h>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "openal_extensions.hpp"
+
+// An area of the world with its own reverb, eg a cave or a hallway, the presets come from efx-presets.h
+struct ReverbZone {
+    enum class Shape { box, sphere };
+
+    Shape shape;
+    glm::vec3 min{0.0f}; // box
+    glm::vec3 max{0.0f}; // box
+    glm::vec3 center{0.0f};
+    float radius = 0.0f; // sphere
+    EFXEAXREVERBPROPERTIES preset;
+
+    static ReverbZone box(glm::vec3 min, glm::vec3 max, const EFXEAXREVERBPROPERTIES &preset);
+    static ReverbZone sphere(glm::vec3 center, float radius, const EFXEAXREVERBPROPERTIES &preset);
+
+    bool contains(glm::vec3 point) const;
+    // 0 when the point is inside
+    float distance_to(glm::vec3 point) const;
+};
+
+using ReverbZoneId = uint32_t;
+
+/**
+ * Only a handful of auxiliary effect slots can run at once, so the zones compete for a small pool of them. The zones
+ * around the listener hold the slots and every voice sends to the slots of the zones nearest to it.
+ *
+ * The assignment only changes when the listener enters or leaves a zone, moving around inside a zone costs one
+ * containment test per zone.
+ */
+class ReverbZoneSystem {
+  public:
+    ReverbZoneSystem(const OpenALExtensions &extensions, int num_slots, int num_sends);
+    ~ReverbZoneSystem();
+
+    ReverbZoneSystem(const ReverbZoneSystem &) = delete;
+    ReverbZoneSystem &operator=(const ReverbZoneSystem &) = delete;
+
+    ReverbZoneId add_zone(const ReverbZone &zone);
+
+    // @return true if the zones holding slots changed, in which case playing voices should be routed again
+    bool update_listener(glm::vec3 listener_position);
+    // points the source's auxiliary sends at the slots of the zones closest to the position, through the send filter
+    void route_source(ALuint source, glm::vec3 position, ALuint send_filter = AL_FILTER_NULL) const;
+
+  private:
+    struct Slot {
+        ALuint effect_slot = 0;
+        ALuint effect = 0;
+        int zone = -1; // -1 when unused
+    };
+
+    const OpenALExtensions &extensions;
+    int num_sends;
+    std::vector<ReverbZone> zones;
+    std::vector<Slot> slots;
+    std::vector<bool> listener_inside_zone;
+    bool assignment_stale = true;
+    glm::vec3 last_listener_position{0.0f};
+
+    void assign_slots(glm::vec3 listener_position);
+    void load_preset(ALuint effect, const EFXEAXREVERBPROPERTIES &preset);
+};
+
+#endif // REVERB_ZONES_HPP
@@ -0,0 +1,18 @@
+#include "server_clock.hpp"
+
+#include <algorithm>
+
+void ServerClock::add_sample(int64_t server_time_ns, int64_t round_trip_ns, int64_t local_time_ns) {
+    samples[num_samples % max_samples] = {local_time_ns - round_trip_ns / 2 - server_time_ns, round_trip_ns};
+    num_samples++;
+
+    auto end = samples.begin() + std::min(num_samples, max_samples);
+    auto best = std::min_element(samples.begin(), end, [](const Sample &a, const Sample &b) {
+        return a.round_trip_ns < b.round_trip_ns;
+    });
+    offset_ns = best->offset_ns;
+}
+
+bool ServerClock::is_synced() const { return num_samples > 0; }
+
+int64_t ServerClock::to_local_time(int64_t server_time_ns) const { return server_time_ns + offset_ns; }
@@ -0,0 +1,36 @@
+#ifndef SERVER_CLOCK_HPP
+#define SERVER_CLOCK_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Maps times on a game server's clock onto the local device clock. It's fed the answers to time sync pings, each one
+ * gives an estimate of the offset between the clocks assuming the answer took half the round trip. Of the recent
+ * estimates the one with the shortest round trip is used since it had the least room for the two ways to differ.
+ */
+class ServerClock {
+  public:
+    /**
+     * @param server_time_ns the server's clock when it answered
+     * @param round_trip_ns from sending the ping to getting the answer
+     * @param local_time_ns the device clock when the answer arrived
+     */
+    void add_sample(int64_t server_time_ns, int64_t round_trip_ns, int64_t local_time_ns);
+    bool is_synced() const;
+    // @return the server time on the local clock, unchanged until there's a sample
+    int64_t to_local_time(int64_t server_time_ns) const;
+
+  private:
+    struct Sample {
+        int64_t offset_ns; // local minus server
+        int64_t round_trip_ns;
+    };
+    static constexpr size_t max_samples = 8;
+    std::array<Sample, max_samples> samples{};
+    size_t num_samples = 0; // ever added, the oldest are overwritten
+    int64_t offset_ns = 0;
+};
+
+#endif // SERVER_CLOCK_HPP
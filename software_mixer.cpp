@@ -0,0 +1,444 @@
+#include "software_mixer.hpp"
+
+#include <AL/alext.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define SOFTWARE_MIXER_SSE
+#endif
+
+// below this many voices per thread handing work to the workers costs more than it saves
+constexpr size_t min_voices_per_thread = 32;
+// -60dB, voices quieter than this for their nearest listener are culled
+constexpr float inaudible_gain = 1e-3f;
+
+/**
+ * stereo_out[2i] += in[i] * left_gain, stereo_out[2i + 1] += in[i] * right_gain
+ */
+static void accumulate_mono_into_stereo(const float *in, size_t count, float left_gain, float right_gain,
+                                        float *stereo_out) {
+    size_t i = 0;
+#ifdef SOFTWARE_MIXER_SSE
+    __m128 left = _mm_set1_ps(left_gain);
+    __m128 right = _mm_set1_ps(right_gain);
+    for (; i + 4 <= count; i += 4) {
+        __m128 samples = _mm_loadu_ps(in + i);
+        __m128 left_samples = _mm_mul_ps(samples, left);
+        __m128 right_samples = _mm_mul_ps(samples, right);
+        // interleave into l0 r0 l1 r1 and l2 r2 l3 r3
+        __m128 first_half = _mm_unpacklo_ps(left_samples, right_samples);
+        __m128 second_half = _mm_unpackhi_ps(left_samples, right_samples);
+        float *out = stereo_out + 2 * i;
+        _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), first_half));
+        _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), second_half));
+    }
+#endif
+    for (; i < count; i++) {
+        stereo_out[2 * i] += in[i] * left_gain;
+        stereo_out[2 * i + 1] += in[i] * right_gain;
+    }
+}
+
+// out[i] += in[i]
+static void accumulate(const float *in, size_t count, float *out) {
+    size_t i = 0;
+#ifdef SOFTWARE_MIXER_SSE
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_loadu_ps(in + i)));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] += in[i];
+    }
+}
+
+// a constant power pan from where the voice is relative to the listener's right
+static void compute_stereo_gains(glm::vec3 to_voice, float distance, glm::vec3 listener_right, float gain,
+                                 float &left_gain, float &right_gain) {
+    float pan = 0;
+    if (distance > 1e-4f) {
+        pan = glm::dot(to_voice, listener_right) / distance;
+    }
+    float angle = (pan + 1.0f) * 0.785398163f; // 0 is hard left, pi / 2 hard right
+    left_gain = std::cos(angle) * gain;
+    right_gain = std::sin(angle) * gain;
+}
+
+static glm::vec3 get_listener_right(const ListenerState &listener) {
+    glm::vec3 right = glm::cross(listener.forward, listener.up);
+    float length = std::sqrt(glm::dot(right, right));
+    return length > 0 ? right / length : glm::vec3(1, 0, 0);
+}
+
+SoftwareMixer::SoftwareMixer(int sample_rate, int block_frames, int num_stream_buffers, unsigned num_threads)
+    : sample_rate(sample_rate), block_frames(block_frames) {
+    assert(sample_rate > 0 && block_frames > 0 && num_stream_buffers > 1);
+    listener_rights.push_back(get_listener_right(listeners[0]));
+
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    worker_blocks.resize(num_threads - 1);
+    for (unsigned i = 0; i + 1 < num_threads; i++) {
+        workers.emplace_back(&SoftwareMixer::worker_loop, this, i);
+    }
+
+    float_output = alIsExtensionPresent("AL_EXT_FLOAT32");
+    stream_block.resize((size_t)block_frames * 2);
+    if (!float_output) {
+        stream_block_int16.resize((size_t)block_frames * 2);
+    }
+
+    alGenSources(1, &stream_source);
+    alSourcei(stream_source, AL_SOURCE_RELATIVE, AL_TRUE);
+    stream_buffers.resize(num_stream_buffers);
+    alGenBuffers(num_stream_buffers, stream_buffers.data());
+    for (ALuint buffer : stream_buffers) {
+        fill_and_queue(buffer);
+    }
+    alSourcePlay(stream_source);
+}
+
+SoftwareMixer::~SoftwareMixer() {
+    if (refill_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(refill_mutex);
+            refill_stopping = true;
+        }
+        refill_wake.notify_one();
+        refill_thread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(work_mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    alSourceStop(stream_source);
+    alDeleteSources(1, &stream_source);
+    alDeleteBuffers((ALsizei)stream_buffers.size(), stream_buffers.data());
+}
+
+uint32_t SoftwareMixer::add_buffer(PcmBuffer pcm, LoudnessEnvelope loudness_envelope) {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    buffers.push_back({std::move(pcm), std::move(loudness_envelope)});
+    return (uint32_t)buffers.size() - 1;
+}
+
+void SoftwareMixer::play(uint32_t buffer_id, glm::vec3 position, float gain, float pitch, BusId bus,
+                         uint32_t start_frame, const SoundAttenuation &attenuation,
+                         AttenuationCurveId attenuation_curve, uint32_t group) {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    assert(buffer_id < buffers.size() && pitch > 0);
+    const Buffer &buffer = buffers[buffer_id];
+    if (start_frame >= buffer.pcm.samples.size()) {
+        return;
+    }
+    double step = (double)buffer.pcm.sample_rate / sample_rate * pitch;
+    pending_voices.push_back(
+        {&buffer, position, gain, bus, attenuation, attenuation_curve, group, (double)start_frame, step});
+    if (group >= pending_group_voice_counts.size()) {
+        pending_group_voice_counts.resize((size_t)group + 1, 0);
+    }
+    pending_group_voice_counts[group]++;
+}
+
+void SoftwareMixer::set_listener(const ListenerState &listener) { set_listeners({&listener, 1}); }
+
+void SoftwareMixer::set_listeners(std::span<const ListenerState> listeners) {
+    assert(!listeners.empty());
+    std::lock_guard<std::mutex> lock(state_mutex);
+    pending_listeners.assign(listeners.begin(), listeners.end());
+}
+
+void SoftwareMixer::set_bus_gains(const std::vector<float> &bus_gains) {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    pending_bus_gains = bus_gains;
+    bus_gains_changed = true;
+}
+
+void SoftwareMixer::set_attenuation_curves(const AttenuationTables &tables) {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    pending_attenuation_tables = tables;
+    attenuation_tables_changed = true;
+}
+
+size_t SoftwareMixer::get_active_voice_count() const {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return mixed_voice_count + pending_voices.size();
+}
+
+size_t SoftwareMixer::get_group_voice_count(uint32_t group) const {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    size_t count = 0;
+    if (group < mixed_group_voice_counts.size()) {
+        count += mixed_group_voice_counts[group];
+    }
+    if (group < pending_group_voice_counts.size()) {
+        count += pending_group_voice_counts[group];
+    }
+    return count;
+}
+
+void SoftwareMixer::accumulate_bus_loudness(std::vector<float> &bus_loudness) const {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    for (BusId bus = 0; bus < std::min(bus_loudness.size(), mixed_bus_loudness.size()); bus++) {
+        bus_loudness[bus] += mixed_bus_loudness[bus];
+    }
+    for (const Voice &voice : pending_voices) {
+        if (voice.bus < bus_loudness.size()) {
+            bus_loudness[voice.bus] += voice.gain * get_loudness(voice);
+        }
+    }
+}
+
+void SoftwareMixer::take_pending_state() {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    voices.insert(voices.end(), pending_voices.begin(), pending_voices.end());
+    pending_voices.clear();
+    std::fill(pending_group_voice_counts.begin(), pending_group_voice_counts.end(), 0);
+    if (!pending_listeners.empty()) {
+        listeners.swap(pending_listeners);
+        pending_listeners.clear();
+        listener_rights.clear();
+        for (const ListenerState &listener : listeners) {
+            listener_rights.push_back(get_listener_right(listener));
+        }
+    }
+    if (bus_gains_changed) {
+        bus_gains = pending_bus_gains;
+        bus_gains_changed = false;
+    }
+    if (attenuation_tables_changed) {
+        attenuation_tables = pending_attenuation_tables;
+        attenuation_tables_changed = false;
+    }
+}
+
+float SoftwareMixer::get_loudness(const Voice &voice) {
+    const LoudnessEnvelope &envelope = voice.buffer->loudness_envelope;
+    return envelope.empty() ? 1.0f : envelope.get_gain((size_t)voice.read_position);
+}
+
+void SoftwareMixer::publish_mixed_state() {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    mixed_voice_count = voices.size();
+    std::fill(mixed_bus_loudness.begin(), mixed_bus_loudness.end(), 0.0f);
+    std::fill(mixed_group_voice_counts.begin(), mixed_group_voice_counts.end(), 0);
+    for (const Voice &voice : voices) {
+        if (voice.bus >= mixed_bus_loudness.size()) {
+            mixed_bus_loudness.resize((size_t)voice.bus + 1, 0.0f);
+        }
+        mixed_bus_loudness[voice.bus] += voice.gain * get_loudness(voice);
+        if (voice.group >= mixed_group_voice_counts.size()) {
+            mixed_group_voice_counts.resize((size_t)voice.group + 1, 0);
+        }
+        mixed_group_voice_counts[voice.group]++;
+    }
+}
+
+void SoftwareMixer::start_refill_thread(const OpenALExtensions &extensions, ALCcontext *context) {
+    if (!extensions.alcSetThreadContext) {
+        throw std::runtime_error("refilling the software mixer on its own thread needs ALC_EXT_thread_local_context");
+    }
+    assert(!refill_thread.joinable());
+    refill_thread = std::thread(&SoftwareMixer::refill_loop, this, std::cref(extensions), context);
+}
+
+void SoftwareMixer::refill_loop(const OpenALExtensions &extensions, ALCcontext *context) {
+    ThreadContextBinding binding(extensions, context);
+    // checking twice a block means a block is refilled at most half a block after OpenAL is done with it
+    auto interval = std::chrono::microseconds((int64_t)block_frames * 500'000 / sample_rate);
+    std::unique_lock<std::mutex> lock(refill_mutex);
+    while (!refill_stopping) {
+        lock.unlock();
+        refill();
+        lock.lock();
+        refill_wake.wait_for(lock, interval, [this] { return refill_stopping; });
+    }
+}
+
+void SoftwareMixer::update() {
+    if (!refill_thread.joinable()) {
+        refill();
+    }
+}
+
+int SoftwareMixer::get_buffered_frames() const { return block_frames * ((int)stream_buffers.size() - 1); }
+
+void SoftwareMixer::refill() {
+    ALint processed = 0;
+    alGetSourcei(stream_source, AL_BUFFERS_PROCESSED, &processed);
+    while (processed-- > 0) {
+        ALuint buffer;
+        alSourceUnqueueBuffers(stream_source, 1, &buffer);
+        fill_and_queue(buffer);
+    }
+
+    // if we couldn't keep up the source runs dry and stops, start it again with what's now queued
+    ALint state;
+    alGetSourcei(stream_source, AL_SOURCE_STATE, &state);
+    if (state != AL_PLAYING) {
+        alSourcePlay(stream_source);
+    }
+}
+
+void SoftwareMixer::fill_and_queue(ALuint buffer) {
+    mix_block(stream_block.data(), block_frames);
+    ALsizei num_samples = block_frames * 2;
+    if (float_output) {
+        alBufferData(buffer, AL_FORMAT_STEREO_FLOAT32, stream_block.data(), num_samples * (ALsizei)sizeof(float),
+                     sample_rate);
+    } else {
+        for (ALsizei i = 0; i < num_samples; i++) {
+            float sample = std::clamp(stream_block[i], -1.0f, 1.0f);
+            stream_block_int16[i] = (short)(sample * 32767.0f);
+        }
+        alBufferData(buffer, AL_FORMAT_STEREO16, stream_block_int16.data(), num_samples * (ALsizei)sizeof(short),
+                     sample_rate);
+    }
+    alSourceQueueBuffers(stream_source, 1, &buffer);
+}
+
+void SoftwareMixer::mix_block(float *stereo_out, int frames) {
+    take_pending_state();
+    std::fill(stereo_out, stereo_out + (size_t)frames * 2, 0.0f);
+
+    size_t num_voices = voices.size();
+    size_t num_threads = workers.size() + 1;
+    if (workers.empty() || num_voices < min_voices_per_thread * 2) {
+        mix_voices(0, num_voices, stereo_out, frames);
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(work_mutex);
+            for (std::vector<float> &block : worker_blocks) {
+                block.resize((size_t)frames * 2);
+            }
+            work_frames = frames;
+            workers_remaining = (unsigned)workers.size();
+            work_generation++;
+        }
+        work_available.notify_all();
+
+        // the calling thread takes the first share
+        size_t share = (num_voices + num_threads - 1) / num_threads;
+        mix_voices(0, std::min(share, num_voices), stereo_out, frames);
+
+        std::unique_lock<std::mutex> lock(work_mutex);
+        work_done.wait(lock, [this] { return workers_remaining == 0; });
+        for (const std::vector<float> &block : worker_blocks) {
+            accumulate(block.data(), (size_t)frames * 2, stereo_out);
+        }
+    }
+
+    // remove the voices which reached the end of their buffer
+    for (size_t i = 0; i < voices.size();) {
+        if (voices[i].read_position >= (double)voices[i].buffer->pcm.samples.size()) {
+            voices[i] = voices.back();
+            voices.pop_back();
+        } else {
+            i++;
+        }
+    }
+    publish_mixed_state();
+}
+
+void SoftwareMixer::worker_loop(unsigned worker_index) {
+    uint64_t seen_generation = 0;
+    while (true) {
+        int frames;
+        {
+            std::unique_lock<std::mutex> lock(work_mutex);
+            work_available.wait(lock, [&] { return stopping || work_generation != seen_generation; });
+            if (stopping) {
+                return;
+            }
+            seen_generation = work_generation;
+            frames = work_frames;
+        }
+
+        std::vector<float> &block = worker_blocks[worker_index];
+        std::fill(block.begin(), block.end(), 0.0f);
+
+        size_t num_voices = voices.size();
+        size_t num_threads = workers.size() + 1;
+        size_t share = (num_voices + num_threads - 1) / num_threads;
+        size_t first_voice = std::min(share * (worker_index + 1), num_voices);
+        size_t last_voice = std::min(first_voice + share, num_voices);
+        mix_voices(first_voice, last_voice, block.data(), frames);
+
+        std::lock_guard<std::mutex> lock(work_mutex);
+        if (--workers_remaining == 0) {
+            work_done.notify_one();
+        }
+    }
+}
+
+void SoftwareMixer::mix_voices(size_t first_voice, size_t last_voice, float *stereo_out, int frames) {
+    for (size_t v = first_voice; v < last_voice; v++) {
+        Voice &voice = voices[v];
+        const std::vector<float> &samples = voice.buffer->pcm.samples;
+
+        float gain = voice.bus < bus_gains.size() ? voice.gain * bus_gains[voice.bus] : voice.gain;
+        size_t listener = listeners.size() == 1 ? 0 : find_nearest_listener(listeners, voice.position);
+        glm::vec3 to_voice = voice.position - listeners[listener].position;
+        float distance = std::sqrt(glm::dot(to_voice, to_voice));
+        float left_gain, right_gain;
+        compute_stereo_gains(to_voice, distance, listener_rights[listener], gain * get_distance_gain(voice, distance),
+                             left_gain, right_gain);
+        if (left_gain + right_gain < inaudible_gain) {
+            // still has to move on so it ends when it would have
+            voice.read_position += voice.step * frames;
+            continue;
+        }
+
+        if (voice.step == 1.0) {
+            // same rate and no pitch shift, so the samples can go straight through the simd kernel
+            size_t start = (size_t)voice.read_position;
+            size_t count = std::min((size_t)frames, samples.size() - start);
+            accumulate_mono_into_stereo(samples.data() + start, count, left_gain, right_gain, stereo_out);
+            voice.read_position += (double)count;
+            continue;
+        }
+
+        // resample with linear interpolation
+        double position = voice.read_position;
+        size_t last_sample = samples.size() - 1;
+        for (int frame = 0; frame < frames; frame++) {
+            size_t index = (size_t)position;
+            if (index > last_sample) {
+                break;
+            }
+            float fraction = (float)(position - (double)index);
+            float next = index < last_sample ? samples[index + 1] : 0.0f;
+            float sample = samples[index] + (next - samples[index]) * fraction;
+            stereo_out[2 * frame] += sample * left_gain;
+            stereo_out[2 * frame + 1] += sample * right_gain;
+            position += voice.step;
+        }
+        voice.read_position = position;
+    }
+}
+
+/**
+ * The curve's gain when the voice has one, otherwise OpenAL's inverse distance clamped model with the voice's own
+ * reference distance, max distance and rolloff
+ */
+float SoftwareMixer::get_distance_gain(const Voice &voice, float distance) const {
+    if (voice.attenuation_curve != no_attenuation_curve && voice.attenuation_curve < attenuation_tables.size()) {
+        return attenuation_tables.evaluate(voice.attenuation_curve, distance).gain;
+    }
+    const SoundAttenuation &attenuation = voice.attenuation;
+    distance = std::min(std::max(distance, attenuation.reference_distance), attenuation.max_distance);
+    float denominator =
+        attenuation.reference_distance + attenuation.rolloff_factor * (distance - attenuation.reference_distance);
+    return denominator > 0.0f ? attenuation.reference_distance / denominator : 1.0f;
+}
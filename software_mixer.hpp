@@ -0,0 +1,170 @@
+#ifndef SOFTWARE_MIXER_HPP
+#define SOFTWARE_MIXER_HPP
+
+#include <AL/al.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "attenuation_curves.hpp"
+#include "listener_state.hpp"
+#include "load_sound_file.hpp"
+#include "mixer_bus.hpp"
+#include "openal_extensions.hpp"
+#include "sound_events.hpp"
+
+// the id of a buffer which hasn't been added to a mixer
+constexpr uint32_t no_mixer_buffer = UINT32_MAX;
+
+/**
+ * Mixes one shot sounds on the cpu into a stereo signal which is streamed through a single OpenAL source, this gets
+ * around the per source overhead of OpenAL when thousands of short sounds are playing at once.
+ *
+ * Voices are split between worker threads which each accumulate into their own block, the blocks are then summed on
+ * the calling thread.
+ *
+ * The stream is refilled by update, or by a thread of the mixer's own once start_refill_thread is called, so a slow
+ * frame doesn't run it dry. Either way play and the setters only hand their changes over, they're picked up at the
+ * start of the next block.
+ */
+class SoftwareMixer {
+  public:
+    /**
+     * @param num_threads how many threads mix, including the calling thread, 0 uses every core
+     */
+    SoftwareMixer(int sample_rate = 48000, int block_frames = 512, int num_stream_buffers = 6,
+                  unsigned num_threads = 0);
+    ~SoftwareMixer();
+
+    SoftwareMixer(const SoftwareMixer &) = delete;
+    SoftwareMixer &operator=(const SoftwareMixer &) = delete;
+
+    /**
+     * @param loudness_envelope what accumulate_bus_loudness follows while the buffer plays, without one the voice
+     * counts as its gain
+     * @return the id to play the buffer with
+     */
+    uint32_t add_buffer(PcmBuffer pcm, LoudnessEnvelope loudness_envelope = {});
+    /**
+     * @param start_frame how far into the buffer to start, in the buffer's own sample rate
+     * @param attenuation attenuated like OpenAL's inverse distance clamped model, unless the voice has a curve
+     * @param attenuation_curve only its gain applies, there's no filter for the low pass or a reverb send
+     * @param group voices are counted per group, see get_group_voice_count
+     */
+    void play(uint32_t buffer_id, glm::vec3 position, float gain, float pitch, BusId bus = buses::sfx,
+              uint32_t start_frame = 0, const SoundAttenuation &attenuation = {},
+              AttenuationCurveId attenuation_curve = no_attenuation_curve, uint32_t group = 0);
+    void set_listener(const ListenerState &listener);
+    /**
+     * Each voice is attenuated and panned for the listener nearest to it, so with split screen every voice is still
+     * only mixed once. Voices too far from every listener to be heard are skipped.
+     */
+    void set_listeners(std::span<const ListenerState> listeners);
+    // the effective gain of each bus, indexed by bus id
+    void set_bus_gains(const std::vector<float> &bus_gains);
+    // a copy is taken, call it again after adding curves
+    void set_attenuation_curves(const AttenuationTables &tables);
+
+    /**
+     * Refills the blocks OpenAL has finished with from now on, the thread binds the context for itself
+     * @throw std::runtime_error without ALC_EXT_thread_local_context
+     */
+    void start_refill_thread(const OpenALExtensions &extensions, ALCcontext *context);
+    /**
+     * Refills the blocks OpenAL has finished with and restarts the stream if it ran dry, without a refill thread call
+     * this at least once per get_buffered_frames, with one it does nothing
+     */
+    void update();
+    // how many frames are queued after an update, it's the most that can be played before the next one
+    int get_buffered_frames() const;
+    // mixes the next frames of every voice into interleaved stereo, finished voices are removed
+    void mix_block(float *stereo_out, int frames);
+
+    size_t get_active_voice_count() const;
+    // includes voices which were played but haven't been mixed yet
+    size_t get_group_voice_count(uint32_t group) const;
+    // adds how loud every playing voice is, its gain times its envelope where it's got to, onto its bus's entry
+    void accumulate_bus_loudness(std::vector<float> &bus_loudness) const;
+
+  private:
+    struct Buffer {
+        PcmBuffer pcm;
+        LoudnessEnvelope loudness_envelope;
+    };
+    struct Voice {
+        const Buffer *buffer; // buffers is a deque so this stays put when more are added
+        glm::vec3 position;
+        float gain;
+        BusId bus;
+        SoundAttenuation attenuation;
+        AttenuationCurveId attenuation_curve;
+        uint32_t group;
+        double read_position; // in frames of the buffer
+        double step;          // buffer frames advanced per output frame
+    };
+
+    int sample_rate;
+    int block_frames;
+    // what's being mixed, only touched by whichever thread mixes
+    std::vector<Voice> voices;
+    std::vector<ListenerState> listeners{1};
+    std::vector<glm::vec3> listener_rights;
+    std::vector<float> bus_gains;
+    AttenuationTables attenuation_tables;
+
+    // handed over by play and the setters, and handed back after each block
+    mutable std::mutex state_mutex;
+    std::deque<Buffer> buffers;
+    std::vector<Voice> pending_voices;
+    std::vector<ListenerState> pending_listeners; // empty when they haven't changed
+    std::vector<float> pending_bus_gains;
+    bool bus_gains_changed = false;
+    AttenuationTables pending_attenuation_tables;
+    bool attenuation_tables_changed = false;
+    std::vector<uint32_t> pending_group_voice_counts;
+    size_t mixed_voice_count = 0;
+    std::vector<float> mixed_bus_loudness; // the gain of every voice that was mixed, summed per bus
+    std::vector<uint32_t> mixed_group_voice_counts;
+    // takes the pending changes, the state mutex mustn't be held
+    void take_pending_state();
+    void publish_mixed_state();
+
+    void mix_voices(size_t first_voice, size_t last_voice, float *stereo_out, int frames);
+    float get_distance_gain(const Voice &voice, float distance) const;
+    // the voice's envelope where it's got to, 1 without one
+    static float get_loudness(const Voice &voice);
+
+    // worker threads, each one owns a scratch block which it mixes its share of the voices into
+    std::vector<std::thread> workers;
+    std::vector<std::vector<float>> worker_blocks;
+    std::mutex work_mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+    uint64_t work_generation = 0;
+    unsigned workers_remaining = 0;
+    int work_frames = 0;
+    bool stopping = false;
+    void worker_loop(unsigned worker_index);
+
+    // streaming output
+    ALuint stream_source = 0;
+    std::vector<ALuint> stream_buffers;
+    std::vector<float> stream_block;
+    std::vector<short> stream_block_int16;
+    bool float_output;
+    void refill();
+    void fill_and_queue(ALuint buffer);
+
+    std::thread refill_thread;
+    std::mutex refill_mutex;
+    std::condition_variable refill_wake;
+    bool refill_stopping = false;
+    void refill_loop(const OpenALExtensions &extensions, ALCcontext *context);
+};
+
+#endif // SOFTWARE_MIXER_HPP
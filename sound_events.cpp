@@ -0,0 +1,144 @@
+#include "sound_events.hpp"
+
+#include <cstring>
+
+#include "binary_file.hpp"
+
+namespace {
+
+constexpr char table_magic[4] = {'S', 'E', 'V', 'T'};
+constexpr uint32_t table_version = 2;
+
+struct TableHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_events;
+    uint32_t num_files;
+    uint32_t string_table_size;
+};
+
+struct EventRecord {
+    uint32_t first_file;
+    uint32_t num_files;
+    float min_pitch;
+    float max_pitch;
+    float min_gain;
+    float max_gain;
+    uint32_t bus;
+    float cooldown;
+    float reference_distance;
+    float max_distance;
+    float rolloff_factor;
+    uint32_t attenuation_curve;
+    uint16_t max_instances;
+    uint8_t priority;
+    uint8_t padding = 0;
+};
+
+struct FileRecord {
+    uint32_t path_offset; // into the string table
+    uint32_t path_length;
+};
+
+// the records are written as is, so their layout must not depend on the compiler
+static_assert(sizeof(TableHeader) == 20 && sizeof(EventRecord) == 52 && sizeof(FileRecord) == 8);
+
+} // namespace
+
+void write_sound_event_table(const std::string &path, const std::vector<SoundEvent> &events) {
+    std::vector<EventRecord> event_records;
+    std::vector<FileRecord> file_records;
+    std::string string_table;
+    for (const SoundEvent &event : events) {
+        EventRecord record;
+        record.first_file = (uint32_t)file_records.size();
+        record.num_files = (uint32_t)event.files.size();
+        record.min_pitch = event.min_pitch;
+        record.max_pitch = event.max_pitch;
+        record.min_gain = event.min_gain;
+        record.max_gain = event.max_gain;
+        record.bus = event.bus;
+        record.cooldown = event.cooldown;
+        record.reference_distance = event.attenuation.reference_distance;
+        record.max_distance = event.attenuation.max_distance;
+        record.rolloff_factor = event.attenuation.rolloff_factor;
+        record.attenuation_curve = event.attenuation_curve;
+        record.max_instances = event.max_instances;
+        record.priority = event.priority;
+        event_records.push_back(record);
+
+        for (const std::string &file : event.files) {
+            file_records.push_back({(uint32_t)string_table.size(), (uint32_t)file.size()});
+            string_table += file;
+        }
+    }
+
+    TableHeader header;
+    std::memcpy(header.magic, table_magic, sizeof(table_magic));
+    header.version = table_version;
+    header.num_events = (uint32_t)event_records.size();
+    header.num_files = (uint32_t)file_records.size();
+    header.string_table_size = (uint32_t)string_table.size();
+
+    FileHandle file(fopen(path.c_str(), "wb"));
+    if (!file) {
+        throw std::runtime_error("couldn't open " + path + " for writing");
+    }
+    std::string what = "the sound event table " + path;
+    write_array(file.get(), &header, 1, what);
+    write_array(file.get(), event_records.data(), event_records.size(), what);
+    write_array(file.get(), file_records.data(), file_records.size(), what);
+    write_array(file.get(), string_table.data(), string_table.size(), what);
+}
+
+std::vector<SoundEvent> read_sound_event_table(const std::string &path) {
+    FileHandle file(fopen(path.c_str(), "rb"));
+    if (!file) {
+        fprintf(stderr, "Could not open sound event table %s\n", path.c_str());
+        throw std::runtime_error("couldn't open the sound event table");
+    }
+
+    std::string what = "the sound event table " + path;
+    TableHeader header;
+    read_array(file.get(), &header, 1, what);
+    if (std::memcmp(header.magic, table_magic, sizeof(table_magic)) != 0 || header.version != table_version) {
+        throw std::runtime_error(path + " isn't a version " + std::to_string(table_version) + " sound event table");
+    }
+
+    std::vector<EventRecord> event_records(header.num_events);
+    std::vector<FileRecord> file_records(header.num_files);
+    std::string string_table(header.string_table_size, '\0');
+    read_array(file.get(), event_records.data(), event_records.size(), what);
+    read_array(file.get(), file_records.data(), file_records.size(), what);
+    read_array(file.get(), string_table.data(), string_table.size(), what);
+
+    std::vector<SoundEvent> events(header.num_events);
+    for (size_t i = 0; i < events.size(); i++) {
+        const EventRecord &record = event_records[i];
+        if ((uint64_t)record.first_file + record.num_files > file_records.size()) {
+            throw std::runtime_error("event " + std::to_string(i) + " in " + path + " refers to missing files");
+        }
+
+        SoundEvent &event = events[i];
+        for (uint32_t f = record.first_file; f < record.first_file + record.num_files; f++) {
+            const FileRecord &file_record = file_records[f];
+            if ((uint64_t)file_record.path_offset + file_record.path_length > string_table.size()) {
+                throw std::runtime_error("a file path in " + path + " runs past the string table");
+            }
+            event.files.push_back(string_table.substr(file_record.path_offset, file_record.path_length));
+        }
+        event.min_pitch = record.min_pitch;
+        event.max_pitch = record.max_pitch;
+        event.min_gain = record.min_gain;
+        event.max_gain = record.max_gain;
+        event.bus = record.bus;
+        event.priority = record.priority;
+        event.max_instances = record.max_instances;
+        event.cooldown = record.cooldown;
+        event.attenuation.reference_distance = record.reference_distance;
+        event.attenuation.max_distance = record.max_distance;
+        event.attenuation.rolloff_factor = record.rolloff_factor;
+        event.attenuation_curve = record.attenuation_curve;
+    }
+    return events;
+}
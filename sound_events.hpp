@@ -0,0 +1,53 @@
+#ifndef SOUND_EVENTS_HPP
+#define SOUND_EVENTS_HPP
+
+#include <cfloat>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "attenuation_curves.hpp"
+#include "mixer_bus.hpp"
+
+// an event's id is its index in the table
+using SoundEventId = uint32_t;
+
+// distance attenuation through OpenAL's per source parameters, the defaults are OpenAL's
+struct SoundAttenuation {
+    float reference_distance = 1.0f;
+    float max_distance = FLT_MAX;
+    float rolloff_factor = 1.0f;
+
+    bool operator==(const SoundAttenuation &) const = default;
+};
+
+/**
+ * Everything needed to play one kind of sound, designers author these and they're compiled offline into a table with
+ * write_sound_event_table
+ */
+struct SoundEvent {
+    std::vector<std::string> files; // the variations, one is picked at random every time
+    float min_pitch = 1.0f;
+    float max_pitch = 1.0f;
+    float min_gain = 1.0f;
+    float max_gain = 1.0f;
+    BusId bus = buses::sfx;
+    // when every voice is busy the event takes the voice of the lowest priority sound below its own
+    uint8_t priority = 128;
+    // how many can play at once, starts over the limit are dropped, 0 for no limit
+    uint16_t max_instances = 0;
+    // in seconds, starts within this long of the last one are dropped
+    float cooldown = 0.0f;
+    SoundAttenuation attenuation;
+    // replaces OpenAL's distance attenuation when set, see SoundSystem::add_attenuation_curve
+    AttenuationCurveId attenuation_curve = no_attenuation_curve;
+};
+
+/**
+ * The table is a header, one fixed size record per event, one record per file and a string table holding the file
+ * paths, all in the writing machine's byte order. Reading it is a handful of bulk reads with no parsing of text.
+ */
+void write_sound_event_table(const std::string &path, const std::vector<SoundEvent> &events);
+std::vector<SoundEvent> read_sound_event_table(const std::string &path);
+
+#endif // SOUND_EVENTS_HPP
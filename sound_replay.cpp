@@ -0,0 +1,110 @@
+#include "sound_replay.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr int render_chunk_frames = 1024;
+
+const std::string &get_trace_string(const SoundTrace &trace, uint32_t index) {
+    if (index >= trace.strings.size()) {
+        throw std::runtime_error("the sound trace names a string it doesn't have");
+    }
+    return trace.strings[index];
+}
+
+} // namespace
+
+ReplayStats replay_sound_trace(const SoundTrace &trace, SoundSystem &sound_system, OfflineRenderer *output) {
+    if (!sound_system.is_loopback()) {
+        throw std::runtime_error("sound traces can only be replayed on a loopback system");
+    }
+    using clock = std::chrono::steady_clock;
+    clock::time_point replay_start = clock::now();
+
+    const LoopbackFormat &format = sound_system.get_loopback_format();
+    std::vector<float> scratch((size_t)render_chunk_frames * format.channels);
+    int64_t first_frame = sound_system.get_rendered_frames();
+    ReplayStats stats;
+    double active_voice_sum = 0.0;
+    std::vector<ListenerState> listeners; // set_listeners comes as an entry per listener
+
+    for (const TraceEntry &entry : trace.entries) {
+        // catch up to when the call was made
+        int64_t entry_frame = first_frame + entry.time_ns * format.sample_rate / 1'000'000'000;
+        if (output && sound_system.get_rendered_frames() < entry_frame) {
+            output->render_frames(entry_frame - sound_system.get_rendered_frames());
+        }
+        while (sound_system.get_rendered_frames() < entry_frame) {
+            int frames = (int)std::min<int64_t>(render_chunk_frames, entry_frame - sound_system.get_rendered_frames());
+            sound_system.render_loopback(scratch.data(), frames);
+        }
+
+        switch (entry.op) {
+        case TraceOp::seed:
+            sound_system.seed_random(entry.id);
+            break;
+        case TraceOp::create_sound_source:
+            sound_system.create_sound_source(get_trace_string(trace, entry.name));
+            break;
+        case TraceOp::queue_sound:
+            sound_system.queue_sound((SoundType)entry.id, entry.get_vec3(0));
+            break;
+        case TraceOp::queue_event:
+            sound_system.queue_event(entry.id, entry.get_vec3(0));
+            break;
+        case TraceOp::queue_sound_at: {
+            int64_t lead_ns = (int64_t)((double)entry.values[3] * 1e9);
+            sound_system.queue_sound_at((SoundType)entry.id, entry.get_vec3(0),
+                                        sound_system.get_device_clock_time() + lead_ns);
+            break;
+        }
+        case TraceOp::play_sound:
+            sound_system.play_sound(get_trace_string(trace, entry.name), get_trace_string(trace, entry.id));
+            break;
+        case TraceOp::set_listener:
+            sound_system.set_listener(entry.get_vec3(0), entry.get_vec3(3), entry.get_vec3(6), entry.get_vec3(9));
+            break;
+        case TraceOp::set_listeners:
+            if (entry.id == 0) {
+                listeners.clear();
+            }
+            listeners.push_back({entry.get_vec3(0), entry.get_vec3(3), entry.get_vec3(6), entry.get_vec3(9)});
+            if (entry.id + 1 == entry.name) {
+                sound_system.set_listeners(listeners);
+            }
+            break;
+        case TraceOp::set_source_gain:
+            sound_system.set_source_gain(get_trace_string(trace, entry.name), entry.values[0]);
+            break;
+        case TraceOp::set_source_looping:
+            sound_system.set_source_looping_option(get_trace_string(trace, entry.name), entry.flag);
+            break;
+        case TraceOp::play_all_sounds: {
+            clock::time_point drain_start = clock::now();
+            const std::vector<VoiceHandle> &handles = sound_system.play_all_sounds();
+            double drain_seconds = std::chrono::duration<double>(clock::now() - drain_start).count();
+
+            stats.num_frames++;
+            stats.num_sounds_started +=
+                std::count_if(handles.begin(), handles.end(), [](VoiceHandle handle) { return handle.is_valid(); });
+            stats.total_drain_seconds += drain_seconds;
+            stats.max_drain_seconds = std::max(stats.max_drain_seconds, drain_seconds);
+            size_t active_voices = sound_system.get_active_voice_count();
+            stats.peak_active_voices = std::max(stats.peak_active_voices, active_voices);
+            active_voice_sum += (double)active_voices;
+            break;
+        }
+        }
+    }
+
+    if (stats.num_frames > 0) {
+        stats.mean_active_voices = active_voice_sum / (double)stats.num_frames;
+    }
+    stats.rendered_seconds = (double)(sound_system.get_rendered_frames() - first_frame) / format.sample_rate;
+    stats.wall_seconds = std::chrono::duration<double>(clock::now() - replay_start).count();
+    return stats;
+}
@@ -0,0 +1,32 @@
+#ifndef SOUND_REPLAY_HPP
+#define SOUND_REPLAY_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "offline_render.hpp"
+#include "sound_system.hpp"
+#include "sound_trace.hpp"
+
+// what a replay cost, the drain is the time spent in play_all_sounds
+struct ReplayStats {
+    uint64_t num_frames = 0;         // calls to play_all_sounds
+    uint64_t num_sounds_started = 0; // on sources, the software mixer doesn't hand out handles
+    double total_drain_seconds = 0.0;
+    double max_drain_seconds = 0.0;
+    size_t peak_active_voices = 0;
+    double mean_active_voices = 0.0; // sampled after every frame
+    double rendered_seconds = 0.0;   // of audio
+    double wall_seconds = 0.0;       // everything the replay took, rendering and writing included
+};
+
+/**
+ * Plays a recorded trace back through a loopback system as fast as it can be rendered, each call is made once as much
+ * audio has been rendered as had passed on the recorder's clock when it was recorded. The system should have the same
+ * sounds loaded as the one which was recorded.
+ * @param output if given the mix is written to it, otherwise it's thrown away
+ * @throw std::runtime_error if the system isn't a loopback one or the trace names a string it doesn't have
+ */
+ReplayStats replay_sound_trace(const SoundTrace &trace, SoundSystem &sound_system, OfflineRenderer *output = nullptr);
+
+#endif // SOUND_REPLAY_HPP
@@ -0,0 +1,123 @@
+#include "sound_stream.hpp"
+
+#include <AL/alext.h>
+#include <cstdio>
+#include <stdexcept>
+
+SoundStream::SoundStream(const char *filename, ALuint source, int num_buffers, int buffer_milliseconds)
+    : source(source) {
+    sound_file.reset(sf_open(filename, SFM_READ, &sound_file_info));
+    if (!sound_file) {
+        fprintf(stderr, "Could not open audio in %s: %s\n", filename, sf_strerror(NULL));
+        throw std::runtime_error("couldn't open audio to stream");
+    }
+
+    float_samples = alIsExtensionPresent("AL_EXT_FLOAT32");
+    int channels = sound_file_info.channels;
+    if (channels == 1) {
+        format = float_samples ? AL_FORMAT_MONO_FLOAT32 : AL_FORMAT_MONO16;
+    } else if (channels == 2) {
+        format = float_samples ? AL_FORMAT_STEREO_FLOAT32 : AL_FORMAT_STEREO16;
+    } else {
+        bool ambisonic = sf_command(sound_file.get(), SFC_WAVEX_GET_AMBISONIC, NULL, 0) == SF_AMBISONIC_B_FORMAT;
+        format = get_multichannel_openal_format(channels, ambisonic, float_samples, ambisonic_order);
+    }
+    if (format == AL_NONE) {
+        fprintf(stderr, "Unsupported channel count in %s (%d)\n", filename, channels);
+        throw std::runtime_error("unsupported channel count to stream");
+    }
+
+    block_frames = (sf_count_t)sound_file_info.samplerate * buffer_milliseconds / 1000;
+    if (float_samples) {
+        float_block.resize((size_t)(block_frames * channels));
+    } else {
+        int16_block.resize((size_t)(block_frames * channels));
+    }
+
+    buffers.resize(num_buffers);
+    alGenBuffers(num_buffers, buffers.data());
+    if (ambisonic_order > 1) {
+        for (ALuint buffer : buffers) {
+            alBufferi(buffer, AL_UNPACK_AMBISONIC_ORDER_SOFT, ambisonic_order);
+        }
+    }
+    // a source which is still playing a buffer of its own can't have it taken off, and the stream loops by itself, a
+    // looping source would never let go of its buffers
+    alSourceStop(source);
+    alSourcei(source, AL_LOOPING, AL_FALSE);
+    alSourcei(source, AL_BUFFER, 0);
+}
+
+SoundStream::~SoundStream() {
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0);
+    alDeleteBuffers((ALsizei)buffers.size(), buffers.data());
+}
+
+void SoundStream::play() {
+    for (ALuint buffer : buffers) {
+        if (!fill_and_queue(buffer)) {
+            break;
+        }
+    }
+    alSourcePlay(source);
+}
+
+void SoundStream::set_looping(bool looping) { this->looping = looping; }
+
+bool SoundStream::update() {
+    ALint processed = 0;
+    alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+    while (processed-- > 0) {
+        ALuint buffer;
+        alSourceUnqueueBuffers(source, 1, &buffer);
+        if (!reached_end) {
+            fill_and_queue(buffer);
+        }
+    }
+
+    ALint queued = 0;
+    alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+    if (queued == 0) {
+        return false;
+    }
+    // if we couldn't keep up the source runs dry and stops, start it again with what's now queued
+    ALint state;
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+    if (state != AL_PLAYING && state != AL_PAUSED) {
+        alSourcePlay(source);
+    }
+    return true;
+}
+
+bool SoundStream::fill_and_queue(ALuint buffer) {
+    sf_count_t num_frames = 0;
+    bool just_rewound = false;
+    while (num_frames < block_frames) {
+        sf_count_t offset = num_frames * sound_file_info.channels;
+        sf_count_t wanted = block_frames - num_frames;
+        sf_count_t num_read = float_samples ? sf_readf_float(sound_file.get(), float_block.data() + offset, wanted)
+                                            : sf_readf_short(sound_file.get(), int16_block.data() + offset, wanted);
+        num_frames += num_read;
+        if (num_read > 0) {
+            just_rewound = false;
+            continue;
+        }
+        // at the end of the file, a file with nothing in it would otherwise be rewound forever
+        if (!looping || just_rewound || sf_seek(sound_file.get(), 0, SEEK_SET) < 0) {
+            reached_end = true;
+            break;
+        }
+        just_rewound = true;
+    }
+    if (num_frames == 0) {
+        return false;
+    }
+
+    size_t sample_size = float_samples ? sizeof(float) : sizeof(short);
+    const void *data = float_samples ? (const void *)float_block.data() : (const void *)int16_block.data();
+    alBufferData(buffer, format, data, (ALsizei)((size_t)num_frames * sound_file_info.channels * sample_size),
+                 sound_file_info.samplerate);
+    alSourceQueueBuffers(source, 1, &buffer);
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef SOUND_STREAM_HPP
+#define SOUND_STREAM_HPP
+
+#include <AL/al.h>
+#include <sndfile.h>
+#include <vector>
+
+#include "load_sound_file.hpp"
+
+/**
+ * Plays a file through a source a block at a time instead of decoding it whole, only the blocks in the ring are held in
+ * memory. This is how large multichannel beds are played.
+ *
+ * The stream queues its buffers on the source, so the source mustn't be given a buffer of its own or set to loop while
+ * the stream exists, the stream does its own looping by seeking back to the start of the file.
+ */
+class SoundStream {
+  public:
+    SoundStream(const char *filename, ALuint source, int num_buffers = 4, int buffer_milliseconds = 250);
+    // stops the source and takes the ring off of it
+    ~SoundStream();
+
+    SoundStream(const SoundStream &) = delete;
+    SoundStream &operator=(const SoundStream &) = delete;
+
+    void play();
+    void set_looping(bool looping);
+    /**
+     * Refills the blocks the source has finished with and restarts the source if it ran dry
+     * @return false once the whole file has been played
+     */
+    bool update();
+
+  private:
+    SoundFileHandle sound_file;
+    SF_INFO sound_file_info{};
+    ALenum format;
+    ALint ambisonic_order = 0;
+    bool float_samples;
+    ALuint source;
+    std::vector<ALuint> buffers;
+    std::vector<float> float_block;
+    std::vector<short> int16_block;
+    sf_count_t block_frames;
+    bool looping = false;
+    bool reached_end = false;
+
+    // @return false if there was nothing left to put in the buffer
+    bool fill_and_queue(ALuint buffer);
+};
+
+#endif // SOUND_STREAM_HPP
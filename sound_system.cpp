@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 #include <ostream>
 #include <stdexcept>
@@ -8,33 +11,99 @@
 #include "AL/alc.h"
 
 SoundSystem::SoundSystem() { initialize_openal(); }
+SoundSystem::SoundSystem(const LoopbackFormat &loopback) { initialize_openal(&loopback); }
 SoundSystem::SoundSystem(int num_sources, std::unordered_map<SoundType, std::string> &sound_type_to_file) {
+    std::unordered_map<SoundType, SoundVariations> sound_type_to_variations;
+    for (auto &[sound_type, file_path] : sound_type_to_file) {
+        sound_type_to_variations[sound_type].files.push_back(file_path);
+    }
     initialize_openal();
-    init_sound_buffers(sound_type_to_file);
+    init_sound_buffers(sound_type_to_variations, nullptr);
+    init_sound_sources(num_sources);
+}
+SoundSystem::SoundSystem(int num_sources, std::unordered_map<SoundType, SoundVariations> &sound_type_to_variations,
+                         const AssetIndex *asset_index, const LoadOptions &load_options,
+                         const LoopbackFormat *loopback)
+    : load_options(load_options) {
+    initialize_openal(loopback);
+    init_sound_buffers(sound_type_to_variations, asset_index);
+    init_sound_sources(num_sources);
+}
+
+SoundSystem::SoundSystem(int num_sources, const std::string &event_table_path, const AssetIndex *asset_index,
+                         const LoadOptions &load_options, const LoopbackFormat *loopback)
+    : load_options(load_options) {
+    std::vector<SoundEvent> events = read_sound_event_table(event_table_path);
+    initialize_openal(loopback);
+    init_sound_events(events, asset_index);
     init_sound_sources(num_sources);
 }
 
 SoundSystem::~SoundSystem() { deinitialize_openal(); }
 
-void SoundSystem::initialize_openal() {
+/**
+ * Opens the preferred device, or a loopback device when given a format, and creates a context on it which this system
+ * owns, the context is only made current for the calling thread when ALC_EXT_thread_local_context is available so
+ * other systems and threads are unaffected
+ */
+void SoundSystem::initialize_openal(const LoopbackFormat *loopback_format) {
     const ALCchar *name;
-    ALCdevice *device;
-    ALCcontext *ctx;
 
     /* Open and initialize a device */
 
-    device = alcOpenDevice(NULL); // open the preferred device
+    OpenALExtensions loopback_extensions;
+    if (loopback_format) {
+        if (loopback_format->channels != 1 && loopback_format->channels != 2) {
+            throw std::runtime_error("loopback devices can only render mono or stereo");
+        }
+        if (!load_openal_loopback_extension(loopback_extensions)) {
+            fprintf(stderr, "Could not open a loopback device, ALC_SOFT_loopback isn't available!\n");
+            throw std::runtime_error("could not open a loopback device");
+        }
+        device = loopback_extensions.alcLoopbackOpenDeviceSOFT(NULL);
+    } else {
+        device = alcOpenDevice(NULL); // open the preferred device
+    }
 
     if (!device) {
         fprintf(stderr, "Could not open a device!\n");
         throw std::runtime_error("could not open a device");
     }
 
-    ctx = alcCreateContext(device, NULL);
-    if (ctx == NULL || alcMakeContextCurrent(ctx) == ALC_FALSE) {
-        if (ctx != NULL)
-            alcDestroyContext(ctx);
+    extensions = load_openal_device_extensions(device);
+
+    std::vector<ALCint> context_attributes;
+    if (loopback_format) {
+        extensions.alcLoopbackOpenDeviceSOFT = loopback_extensions.alcLoopbackOpenDeviceSOFT;
+        extensions.alcIsRenderFormatSupportedSOFT = loopback_extensions.alcIsRenderFormatSupportedSOFT;
+        extensions.alcRenderSamplesSOFT = loopback_extensions.alcRenderSamplesSOFT;
+        ALCint channels = loopback_format->channels == 1 ? ALC_MONO_SOFT : ALC_STEREO_SOFT;
+        if (!extensions.alcIsRenderFormatSupportedSOFT(device, loopback_format->sample_rate, channels,
+                                                       ALC_FLOAT_SOFT)) {
+            alcCloseDevice(device);
+            device = nullptr;
+            fprintf(stderr, "The loopback device can't render %d channels of floats at %dHz!\n",
+                    loopback_format->channels, loopback_format->sample_rate);
+            throw std::runtime_error("unsupported loopback format");
+        }
+        context_attributes.insert(context_attributes.end(),
+                                  {ALC_FORMAT_CHANNELS_SOFT, channels, ALC_FORMAT_TYPE_SOFT, ALC_FLOAT_SOFT,
+                                   ALC_FREQUENCY, loopback_format->sample_rate});
+        loopback = true;
+        this->loopback_format = *loopback_format;
+    }
+    // ask for enough auxiliary sends to reach every reverb slot, the default is only 2
+    if (alcIsExtensionPresent(device, "ALC_EXT_EFX")) {
+        context_attributes.insert(context_attributes.end(), {ALC_MAX_AUXILIARY_SENDS, num_reverb_slots});
+    }
+    context_attributes.push_back(0);
+    context = alcCreateContext(device, context_attributes.size() > 1 ? context_attributes.data() : NULL);
+    if (context == NULL || !bind_context(extensions, context)) {
+        if (context != NULL)
+            alcDestroyContext(context);
         alcCloseDevice(device);
+        context = nullptr;
+        device = nullptr;
         fprintf(stderr, "Could not set a context!\n");
         throw std::runtime_error("Could not set a context!\n");
     }
@@ -46,52 +115,109 @@ void SoundSystem::initialize_openal() {
         name = alcGetString(device, ALC_DEVICE_SPECIFIER);
 
     printf("Opened \"%s\"\n", name);
+
+    load_openal_context_extensions(device, extensions);
+    if (extensions.source_distance_model) {
+        alEnable(AL_SOURCE_DISTANCE_MODEL);
+    }
 }
 
 void SoundSystem::deinitialize_openal() {
-
-    /* All done. Delete resources, and close down OpenAL. */
-    for (auto const &[sound_name, buffer_id] : sound_name_to_loaded_buffer) {
-        alDeleteBuffers(1, &buffer_id);
+    if (context == nullptr) {
+        return;
     }
+    bind_context(extensions, context);
 
-    for (auto const &[source_name, source_id] : source_name_to_source_id) {
-        alDeleteSources(1, &source_id);
-    }
+    // the mixer owns a source and buffers of its own
+    software_mixer.reset();
+    // streams detach their buffers from the sources they play on
+    voice_index_to_stream.clear();
 
+    /* All done. Delete resources, and close down OpenAL. Sources go first as a buffer can't be deleted while it is
+     * still attached to a source. */
     // NEW
-    for (ALuint source : sound_sources) {
-        alDeleteSources(1, &source);
+    for (const Voice &voice : voices) {
+        alDeleteSources(1, &voice.source);
+        if (voice.direct_filter) {
+            extensions.alDeleteFilters(1, &voice.direct_filter);
+        }
+        if (voice.send_filter) {
+            extensions.alDeleteFilters(1, &voice.send_filter);
+        }
     }
-    // NEW
+    voices.clear();
 
-    ALCdevice *device;
-    ALCcontext *ctx;
+    // effect slots can't be deleted while sources still send to them
+    reverb_zones.reset();
 
-    ctx = alcGetCurrentContext();
-    if (ctx == NULL)
-        return;
+    for (auto const &[sound_type, sound_type_buffers] : sound_buffers) {
+        for (const VariationBuffer &variation_buffer : sound_type_buffers.buffers) {
+            alDeleteBuffers(1, &variation_buffer.buffer);
+        }
+    }
+    for (const SoundTypeBuffers &event : event_buffers) {
+        for (const VariationBuffer &variation_buffer : event.buffers) {
+            alDeleteBuffers(1, &variation_buffer.buffer);
+        }
+    }
+    // NEW
 
-    device = alcGetContextsDevice(ctx);
+    for (auto const &[sound_name, buffer_id] : sound_name_to_loaded_buffer) {
+        alDeleteBuffers(1, &buffer_id);
+    }
 
-    alcMakeContextCurrent(NULL);
-    alcDestroyContext(ctx);
+    // only tear down our own context, never whatever some other system has made current
+    if (extensions.alcGetThreadContext && extensions.alcGetThreadContext() == context) {
+        extensions.alcSetThreadContext(NULL);
+    }
+    if (alcGetCurrentContext() == context) {
+        alcMakeContextCurrent(NULL);
+    }
+    alcDestroyContext(context);
     alcCloseDevice(device);
+    context = nullptr;
+    device = nullptr;
+}
+
+ThreadContextBinding SoundSystem::bind_to_this_thread() const { return ThreadContextBinding(extensions, context); }
+
+void SoundSystem::make_context_current() {
+    if (!bind_context(extensions, context)) {
+        throw std::runtime_error("could not make the sound system's context current");
+    }
 }
 
 void SoundSystem::create_sound_source(const std::string &source_name) {
+    make_context_current();
+    if (trace_recorder) {
+        trace_recorder->record_create_sound_source(source_name);
+    }
 
-    bool source_name_available = source_name_to_source_id.count(source_name) == 0;
+    bool source_name_available = source_name_to_voice_index.count(source_name) == 0;
     if (!source_name_available) {
         throw std::runtime_error("a source with the same name was already created.");
     }
 
     /* Create the source to play the sound with. */
-    ALuint source_id = 0;
-    alGenSources(1, &source_id);
-    assert(alGetError() == AL_NO_ERROR && "Failed to setup sound source");
+    Voice voice;
+    voice.named = true;
+    alGenSources(1, &voice.source);
+    if (!check_al_error("creating a source")) {
+        throw std::runtime_error("failed to setup sound source");
+    }
+
+    uint32_t voice_index = (uint32_t)voices.size();
+    voices.push_back(voice);
+    bus_graph.add_voice(voice.bus, voice_index);
+    source_name_to_voice_index[source_name] = voice_index;
+}
 
-    source_name_to_source_id[source_name] = source_id;
+SoundSystem::Voice &SoundSystem::get_named_voice(const std::string &source_name) {
+    auto voice_index_it = source_name_to_voice_index.find(source_name);
+    if (voice_index_it == source_name_to_voice_index.end()) {
+        throw std::runtime_error("you tried to use a source which doesn't exist");
+    }
+    return voices[voice_index_it->second];
 }
 
 /**
@@ -99,8 +225,14 @@ void SoundSystem::create_sound_source(const std::string &source_name) {
  * somehow play two at once? or just overwrite the last sound playing.
  */
 void SoundSystem::play_sound(const std::string &source_name, const std::string &sound_name) {
-    bool source_exists = source_name_to_source_id.count(source_name) == 1;
-    bool sound_exists = sound_name_to_loaded_buffer.count(sound_name) == 1;
+    make_context_current();
+    if (trace_recorder) {
+        trace_recorder->record_play_sound(source_name, sound_name);
+    }
+    bool source_exists = source_name_to_voice_index.count(source_name) == 1;
+    auto streamed_file_it = sound_name_to_streamed_file.find(sound_name);
+    bool is_streamed = streamed_file_it != sound_name_to_streamed_file.end();
+    bool sound_exists = sound_name_to_loaded_buffer.count(sound_name) == 1 || is_streamed;
 
     if (!sound_exists) {
         throw std::runtime_error("You tried to play a sound which doesn't exist.");
@@ -109,145 +241,1357 @@ void SoundSystem::play_sound(const std::string &source_name, const std::string &
         throw std::runtime_error("You tried to play a sound from a source which doesn't exist.");
     }
 
+    // whatever was streaming on the source makes way, this also stops the source
+    uint32_t voice_index = source_name_to_voice_index[source_name];
+    Voice &voice = voices[voice_index];
+    if (voice_index_to_stream.erase(voice_index) == 1) {
+        alSourcei(voice.source, AL_LOOPING, voice.looping ? AL_TRUE : AL_FALSE);
+    }
+
+    // procedural and streamed sounds aren't measured
+    auto loudness_it = sound_name_to_loudness.find(sound_name);
+    float loudness = loudness_it == sound_name_to_loudness.end() ? unmeasured_loudness : loudness_it->second;
+    voice.loudness_trim = get_loudness_trim(loudness);
+    voice.loudness = get_loudness_gain(loudness) * voice.loudness_trim;
+    auto envelope_it = sound_name_to_loudness_envelope.find(sound_name);
+    voice.loudness_envelope =
+        envelope_it == sound_name_to_loudness_envelope.end() ? nullptr : &envelope_it->second;
+    alSourcef(voice.source, AL_GAIN, voice.get_gain(bus_graph.get_effective_gain(voice.bus)));
+
+    if (is_streamed) {
+        auto stream = std::make_unique<SoundStream>(streamed_file_it->second.c_str(), voice.source);
+        stream->set_looping(voice.looping);
+        stream->play();
+        voice_index_to_stream[voice_index] = std::move(stream);
+        voice.active = true;
+        check_al_error("starting stream");
+        return;
+    }
+
     ALuint loaded_sound_buffer_id = sound_name_to_loaded_buffer[sound_name];
     if (loaded_sound_buffer_id == 0) {
         std::cerr << "Loaded sound buffer ID is invalid!" << std::endl;
         return;
     }
 
-    ALuint source_id = source_name_to_source_id[source_name];
+    ALuint source_id = voices[source_name_to_voice_index[source_name]].source;
 
     // Check the state of the source
     ALint state;
     alGetSourcei(source_id, AL_SOURCE_STATE, &state);
     if (state == AL_PLAYING) {
         alSourceStop(source_id);
-        ALenum error = alGetError();
-        if (error != AL_NO_ERROR) {
-            std::cerr << "OpenAL error stopping source: " << alGetString(error) << std::endl;
+        if (!check_al_error("stopping source")) {
             return;
         }
     }
 
     // Now it's safe to set the buffer
     alSourcei(source_id, AL_BUFFER, (ALint)loaded_sound_buffer_id);
-    ALenum error = alGetError();
-    if (error != AL_NO_ERROR) {
-        std::cerr << "OpenAL error setting buffer: " << alGetString(error) << std::endl;
+    if (!check_al_error("setting buffer")) {
         return;
     }
 
-    // Play the source
+    // Play the source, its position is counted from this frame for ducking
+    ALint sample_rate = 0;
+    alGetBufferi(loaded_sound_buffer_id, AL_FREQUENCY, &sample_rate);
     alSourcePlay(source_id);
-    error = alGetError();
-    if (error != AL_NO_ERROR) {
-        std::cerr << "OpenAL error playing source: " << alGetString(error) << std::endl;
-    }
+    voice.start_time = frame_time;
+    voice.start_frame = 0.0;
+    voice.frames_per_second = sample_rate;
+    voice.active = true;
+    check_al_error("playing source");
 }
 
 void SoundSystem::load_sound_into_system_for_playback(const std::string &sound_name, const char *filename) {
-    bool sound_name_available = sound_name_to_loaded_buffer.count(sound_name) == 0;
+    make_context_current();
+    bool sound_name_available =
+        sound_name_to_loaded_buffer.count(sound_name) == 0 && sound_name_to_streamed_file.count(sound_name) == 0;
     if (!sound_name_available) {
         throw std::runtime_error("a sound with the same name was already loaded.");
     }
 
-    ALuint sound_buffer = load_sound_and_generate_openal_buffer(filename);
+    if (get_sound_file_channel_count(filename) > 2) {
+        sound_name_to_streamed_file[sound_name] = filename;
+        return;
+    }
+
+    float loudness;
+    LoudnessEnvelope loudness_envelope;
+    ALuint sound_buffer = load_sound_and_generate_openal_buffer(filename, &loudness, load_options, &loudness_envelope);
 
     if (!sound_buffer) {
         deinitialize_openal();
         throw std::runtime_error("failed to generate sound buffer");
     }
 
+    sound_name_to_loaded_buffer[sound_name] = sound_buffer;
+    sound_name_to_loudness[sound_name] = loudness;
+    sound_name_to_loudness_envelope[sound_name] = std::move(loudness_envelope);
+}
+
+/**
+ * OpenAL calls this from its mixer thread whenever the source needs more samples
+ */
+static ALsizei AL_APIENTRY fill_procedural_buffer(ALvoid *user_pointer, ALvoid *data, ALsizei num_bytes) {
+    SampleGenerator &generator = *static_cast<SampleGenerator *>(user_pointer);
+    size_t num_written = generator(static_cast<float *>(data), (size_t)num_bytes / sizeof(float));
+    return (ALsizei)(num_written * sizeof(float));
+}
+
+void SoundSystem::load_procedural_sound_into_system_for_playback(const std::string &sound_name,
+                                                                 SampleGenerator generator, int sample_rate) {
+    make_context_current();
+    bool sound_name_available =
+        sound_name_to_loaded_buffer.count(sound_name) == 0 && sound_name_to_streamed_file.count(sound_name) == 0;
+    if (!sound_name_available) {
+        throw std::runtime_error("a sound with the same name was already loaded.");
+    }
+    if (!extensions.alBufferCallbackSOFT) {
+        throw std::runtime_error("procedural sounds need AL_SOFT_callback_buffer");
+    }
+
+    procedural_generators.push_back(std::make_unique<SampleGenerator>(std::move(generator)));
+    alGetError();
+    ALuint sound_buffer;
+    alGenBuffers(1, &sound_buffer);
+    extensions.alBufferCallbackSOFT(sound_buffer, AL_FORMAT_MONO_FLOAT32, sample_rate, fill_procedural_buffer,
+                                    procedural_generators.back().get());
+    if (alGetError() != AL_NO_ERROR) {
+        alDeleteBuffers(1, &sound_buffer);
+        procedural_generators.pop_back();
+        throw std::runtime_error("failed to set up the procedural sound's callback");
+    }
+
     sound_name_to_loaded_buffer[sound_name] = sound_buffer;
 }
 
 void SoundSystem::set_listener_position(float x, float y, float z) {
-    ALfloat listener_pos[] = {x, y, z};
-    alListenerfv(AL_POSITION, listener_pos);
-    assert(alGetError() == AL_NO_ERROR && "Failed to setup sound source");
+    ListenerState state = listener_state;
+    state.position = glm::vec3(x, y, z);
+    set_listener(state);
+}
+
+void SoundSystem::set_listener(glm::vec3 position, glm::vec3 forward, glm::vec3 up, glm::vec3 velocity) {
+    set_listener({position, forward, up, velocity});
+}
+
+static bool differs_by_more_than(glm::vec3 a, glm::vec3 b, float epsilon) {
+    glm::vec3 difference = a - b;
+    return glm::dot(difference, difference) > epsilon * epsilon;
+}
+
+void SoundSystem::set_listener(const ListenerState &state) {
+    make_context_current();
+    if (trace_recorder) {
+        trace_recorder->record_listener(state);
+    }
+    listener_state = state;
+    submit_listener(state);
+    if (!split_listeners.empty()) {
+        // back to one listener, so the sources go back to where they really are
+        split_listeners.clear();
+        reposition_sources();
+    }
+}
+
+void SoundSystem::set_listeners(std::span<const ListenerState> states) {
+    assert(!states.empty());
+    if (states.size() == 1) {
+        set_listener(states[0]);
+        return;
+    }
+    make_context_current();
+    if (trace_recorder) {
+        trace_recorder->record_listeners(states);
+    }
+    split_listeners.assign(states.begin(), states.end());
+    listener_state = states[0];
+    // OpenAL hears everything from the origin and the sources are moved into the space of their nearest listener
+    submit_listener(ListenerState{});
+    reposition_sources();
+}
+
+const ListenerState &SoundSystem::get_nearest_listener(glm::vec3 position) const {
+    if (split_listeners.empty()) {
+        return listener_state;
+    }
+    return split_listeners[find_nearest_listener(split_listeners, position)];
+}
+
+glm::vec3 SoundSystem::get_source_position(glm::vec3 position) const {
+    if (split_listeners.empty()) {
+        return position;
+    }
+    return to_listener_space(get_nearest_listener(position), position);
+}
+
+glm::vec3 SoundSystem::get_source_velocity(glm::vec3 position, glm::vec3 velocity) const {
+    if (split_listeners.empty()) {
+        return velocity;
+    }
+    const ListenerState &listener = get_nearest_listener(position);
+    return rotate_into_listener_space(listener, velocity - listener.velocity);
+}
+
+void SoundSystem::reposition_sources() {
+    if (extensions.alDeferUpdatesSOFT) {
+        extensions.alDeferUpdatesSOFT();
+    }
+    // named sources aren't positioned by the system so they're left alone
+    for (const Voice &voice : voices) {
+        if (voice.active && !voice.named) {
+            glm::vec3 position = get_source_position(voice.position);
+            glm::vec3 velocity = get_source_velocity(voice.position, voice.velocity);
+            alSource3f(voice.source, AL_POSITION, position.x, position.y, position.z);
+            alSource3f(voice.source, AL_VELOCITY, velocity.x, velocity.y, velocity.z);
+        }
+    }
+    if (extensions.alProcessUpdatesSOFT) {
+        extensions.alProcessUpdatesSOFT();
+    }
+    check_al_error("moving sources to their listener");
+}
+
+void SoundSystem::submit_listener(const ListenerState &state) {
+    // compare against what was last submitted rather than the last request, so slow movement still adds up
+    bool first_submission = !listener_submitted;
+    if (first_submission || differs_by_more_than(state.position, submitted_listener_state.position, listener_epsilon)) {
+        alListener3f(AL_POSITION, state.position.x, state.position.y, state.position.z);
+        submitted_listener_state.position = state.position;
+    }
+    if (first_submission || differs_by_more_than(state.forward, submitted_listener_state.forward, listener_epsilon) ||
+        differs_by_more_than(state.up, submitted_listener_state.up, listener_epsilon)) {
+        ALfloat orientation[] = {state.forward.x, state.forward.y, state.forward.z, state.up.x, state.up.y, state.up.z};
+        alListenerfv(AL_ORIENTATION, orientation);
+        submitted_listener_state.forward = state.forward;
+        submitted_listener_state.up = state.up;
+    }
+    if (first_submission || differs_by_more_than(state.velocity, submitted_listener_state.velocity, listener_epsilon)) {
+        alListener3f(AL_VELOCITY, state.velocity.x, state.velocity.y, state.velocity.z);
+        submitted_listener_state.velocity = state.velocity;
+    }
+    listener_submitted = true;
+    check_al_error("setting listener");
+}
+
+void SoundSystem::set_listener_interpolated(const ListenerState &previous_tick, const ListenerState &current_tick,
+                                            float alpha) {
+    ListenerState state;
+    state.position = glm::mix(previous_tick.position, current_tick.position, alpha);
+    state.velocity = glm::mix(previous_tick.velocity, current_tick.velocity, alpha);
+
+    // normalized lerp, close enough to a slerp for the small rotations between two ticks
+    glm::vec3 forward = glm::mix(previous_tick.forward, current_tick.forward, alpha);
+    glm::vec3 up = glm::mix(previous_tick.up, current_tick.up, alpha);
+    state.forward = glm::dot(forward, forward) > 0 ? glm::normalize(forward) : current_tick.forward;
+    state.up = glm::dot(up, up) > 0 ? glm::normalize(up) : current_tick.up;
+
+    set_listener(state);
+}
+
+void SoundSystem::set_listener_epsilon(float epsilon) {
+    assert(epsilon >= 0);
+    listener_epsilon = epsilon;
+}
+
+const ListenerState &SoundSystem::get_listener() const { return listener_state; }
+
+void SoundSystem::set_loudness_normalization(bool enabled, float target_loudness) {
+    loudness_normalization = enabled;
+    loudness_target = target_loudness;
+    for (auto &[sound_type, sound_type_buffers] : sound_buffers) {
+        for (VariationBuffer &variation_buffer : sound_type_buffers.buffers) {
+            update_loudness_trim(variation_buffer);
+        }
+    }
+    for (SoundTypeBuffers &event_buffer : event_buffers) {
+        for (VariationBuffer &variation_buffer : event_buffer.buffers) {
+            update_loudness_trim(variation_buffer);
+        }
+    }
+}
+
+void SoundSystem::set_load_options(const LoadOptions &options) { load_options = options; }
+
+bool SoundSystem::is_loopback() const { return loopback; }
+
+const LoopbackFormat &SoundSystem::get_loopback_format() const { return loopback_format; }
+
+void SoundSystem::render_loopback(float *interleaved, int num_frames) {
+    if (!loopback) {
+        throw std::runtime_error("only a system made with a loopback format can render");
+    }
+    if (!software_mixer) {
+        extensions.alcRenderSamplesSOFT(device, interleaved, num_frames);
+        rendered_frames += num_frames;
+        return;
+    }
+    // rendering more than the mixer has queued would run its stream dry, so it's refilled along the way
+    make_context_current();
+    int max_frames = software_mixer->get_buffered_frames();
+    for (int rendered = 0; rendered < num_frames;) {
+        int frames = std::min(num_frames - rendered, max_frames);
+        software_mixer->update();
+        extensions.alcRenderSamplesSOFT(device, interleaved + (size_t)rendered * loopback_format.channels, frames);
+        rendered_frames += frames;
+        rendered += frames;
+    }
+}
+
+int64_t SoundSystem::get_rendered_frames() const { return rendered_frames; }
+
+void SoundSystem::seed_random(uint32_t seed) { random_number_generator.seed(seed); }
+
+size_t SoundSystem::get_active_voice_count() const {
+    size_t count = std::count_if(voices.begin(), voices.end(), [](const Voice &voice) { return voice.active; });
+    if (software_mixer) {
+        count += software_mixer->get_active_voice_count();
+    }
+    return count;
+}
+
+void SoundSystem::set_trace_recorder(TraceRecorder *recorder) {
+    trace_recorder = recorder;
+    if (recorder) {
+        uint32_t seed = std::random_device{}();
+        seed_random(seed);
+        recorder->record_seed(seed);
+    }
+}
+
+float SoundSystem::get_loudness_trim(float loudness) const {
+    return loudness_normalization ? ::get_loudness_trim(loudness, loudness_target) : 1.0f;
+}
+
+void SoundSystem::update_loudness_trim(VariationBuffer &variation_buffer) const {
+    variation_buffer.loudness_trim = get_loudness_trim(variation_buffer.loudness_lufs);
+    variation_buffer.loudness = get_loudness_gain(variation_buffer.loudness_lufs) * variation_buffer.loudness_trim;
+}
+
+void SoundSystem::set_error_check_mode(ErrorCheckMode mode) {
+    make_context_current();
+    // don't let an error from before the switch get blamed on whatever is checked next
+    if (mode != ErrorCheckMode::off) {
+        alGetError();
+    }
+    error_check_mode = mode;
+}
+
+bool SoundSystem::check_al_error(const char *operation) {
+    if (error_check_mode != ErrorCheckMode::checked) {
+        return true;
+    }
+    ALenum error = alGetError();
+    if (error != AL_NO_ERROR) {
+        std::cerr << "OpenAL error " << operation << ": " << alGetString(error) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * OpenAL only remembers the first error since it was last read, so in deferred mode all we can say is which frame it
+ * happened in. In checked mode this catches errors from the calls which aren't checked individually, so they don't get
+ * blamed on the next checked call.
+ */
+void SoundSystem::check_frame_al_error() {
+    if (error_check_mode == ErrorCheckMode::off) {
+        return;
+    }
+    ALenum error = alGetError();
+    if (error != AL_NO_ERROR) {
+        std::cerr << "OpenAL error during frame " << frame_index << ": " << alGetString(error) << std::endl;
+    }
 }
 
 void SoundSystem::set_source_gain(const std::string &source_name, float gain) {
+    make_context_current();
+    if (trace_recorder) {
+        trace_recorder->record_source_gain(source_name, gain);
+    }
 
     assert(0 <= gain && gain <= 1);
 
-    bool source_exists = source_name_to_source_id.count(source_name) == 1;
+    bool source_exists = source_name_to_voice_index.count(source_name) == 1;
     if (!source_exists) {
         throw std::runtime_error("you tried to play a sound from a source which doesn't exist");
     }
 
-    ALuint source_id = source_name_to_source_id[source_name];
-
-    alGetError(); // clear error state
-    alSourcef(source_id, AL_GAIN, gain);
-    assert(alGetError() == AL_NO_ERROR && "Failed to set gain");
+    Voice &voice = voices[source_name_to_voice_index[source_name]];
+    voice.base_gain = gain;
+    ALuint source_id = voice.source;
 
-    //    if ((error = alGetError()) != AL_NO_ERROR)
-    //        DisplayALError("alSourcef 0 AL_GAIN : \n", error);
+    alSourcef(source_id, AL_GAIN, voice.get_gain(bus_graph.get_effective_gain(voice.bus)));
+    check_al_error("setting gain");
 }
 
 void SoundSystem::set_source_looping_option(const std::string &source_name, bool looping) {
+    make_context_current();
+    if (trace_recorder) {
+        trace_recorder->record_source_looping(source_name, looping);
+    }
 
-    bool source_exists = source_name_to_source_id.count(source_name) == 1;
+    bool source_exists = source_name_to_voice_index.count(source_name) == 1;
     if (!source_exists) {
         throw std::runtime_error("you tried to play a sound from a source which doesn't exist");
     }
 
-    ALuint source_id = source_name_to_source_id[source_name];
+    uint32_t voice_index = source_name_to_voice_index[source_name];
+    voices[voice_index].looping = looping;
+    auto stream_it = voice_index_to_stream.find(voice_index);
+    if (stream_it != voice_index_to_stream.end()) {
+        stream_it->second->set_looping(looping);
+        return;
+    }
+
+    ALuint source_id = voices[voice_index].source;
 
     ALboolean looping_status = looping ? AL_TRUE : AL_FALSE;
 
     alSourcei(source_id, AL_LOOPING, looping_status);
-    assert(alGetError() == AL_NO_ERROR && "Failed to set looping option");
-    //    if ((error = alGetError()) != AL_NO_ERROR)
-    //        DisplayALError("alSourcei 0 AL_LOOPING true: \n", error);
+    check_al_error("setting looping option");
 }
 
 // NEW
 //
-void SoundSystem::init_sound_buffers(std::unordered_map<SoundType, std::string> &sound_type_to_file) {
-    for (auto &pair : sound_type_to_file) {
-        SoundType sound_type = pair.first;
-        std::string file_path = pair.second;
-        sound_buffers[sound_type] = load_sound_and_generate_openal_buffer(file_path.c_str());
+void SoundSystem::init_sound_buffers(std::unordered_map<SoundType, SoundVariations> &sound_type_to_variations,
+                                     const AssetIndex *asset_index) {
+    std::vector<std::pair<SoundTypeBuffers *, const std::vector<std::string> *>> sounds;
+    for (auto &[sound_type, variations] : sound_type_to_variations) {
+        if (variations.files.empty()) {
+            throw std::runtime_error("a sound type must have at least one file to play.");
+        }
+        if (variations.bus >= bus_graph.get_bus_count()) {
+            throw std::runtime_error("a sound type plays on a bus which doesn't exist.");
+        }
+        assert(variations.min_pitch > 0 && variations.min_pitch <= variations.max_pitch);
+        assert(0 <= variations.min_gain && variations.min_gain <= variations.max_gain);
+
+        SoundTypeBuffers &sound_type_buffers = sound_buffers[sound_type];
+        sound_type_buffers.min_pitch = variations.min_pitch;
+        sound_type_buffers.max_pitch = variations.max_pitch;
+        sound_type_buffers.min_gain = variations.min_gain;
+        sound_type_buffers.max_gain = variations.max_gain;
+        sound_type_buffers.bus = variations.bus;
+        sounds.push_back({&sound_type_buffers, &variations.files});
+    }
+    load_variation_buffers(sounds, asset_index);
+}
+
+void SoundSystem::init_sound_events(const std::vector<SoundEvent> &events, const AssetIndex *asset_index) {
+    // sized up front, voices point into this
+    event_buffers.resize(events.size());
+    std::vector<std::pair<SoundTypeBuffers *, const std::vector<std::string> *>> sounds;
+    for (size_t i = 0; i < events.size(); i++) {
+        const SoundEvent &event = events[i];
+        if (event.files.empty()) {
+            throw std::runtime_error("sound event " + std::to_string(i) + " has no files to play.");
+        }
+        // the table is read before the game can create buses, so only the built in ones exist yet
+        if (event.bus >= bus_graph.get_bus_count()) {
+            throw std::runtime_error("sound event " + std::to_string(i) + " plays on a bus which doesn't exist.");
+        }
+        assert(event.min_pitch > 0 && event.min_pitch <= event.max_pitch);
+        assert(0 <= event.min_gain && event.min_gain <= event.max_gain);
+
+        SoundTypeBuffers &event_buffer = event_buffers[i];
+        event_buffer.min_pitch = event.min_pitch;
+        event_buffer.max_pitch = event.max_pitch;
+        event_buffer.min_gain = event.min_gain;
+        event_buffer.max_gain = event.max_gain;
+        event_buffer.bus = event.bus;
+        event_buffer.priority = event.priority;
+        event_buffer.max_instances = event.max_instances;
+        event_buffer.cooldown = event.cooldown;
+        event_buffer.attenuation = event.attenuation;
+        event_buffer.attenuation_curve = event.attenuation_curve;
+        sounds.push_back({&event_buffer, &event.files});
+    }
+    load_variation_buffers(sounds, asset_index);
+}
+
+void SoundSystem::load_variation_buffers(
+    const std::vector<std::pair<SoundTypeBuffers *, const std::vector<std::string> *>> &sounds,
+    const AssetIndex *asset_index) {
+    // every file is loaded up front in one batch so the decoding and uploading can be spread across threads
+    variation_load_options = load_options;
+    std::vector<std::string> file_paths;
+    for (const auto &[sound, files] : sounds) {
+        if (sound->buffers.empty()) {
+            sound->mixer_group = num_mixer_groups++;
+        }
+        file_paths.insert(file_paths.end(), files->begin(), files->end());
+        sound->buffers.reserve(sound->buffers.size() + files->size());
+    }
+
+    std::vector<ALuint> loaded_buffers;
+    std::vector<float> loaded_loudness;
+    std::vector<LoudnessEnvelope> loaded_envelopes;
+    if (asset_index) {
+        asset_index->validate(file_paths);
+        // the workers take files in order, starting on the largest keeps one long decode from finishing last
+        std::vector<size_t> load_order(file_paths.size());
+        for (size_t i = 0; i < load_order.size(); i++) {
+            load_order[i] = i;
+        }
+        auto projected_bytes = [&](size_t i) {
+            const AssetIndexEntry *entry = asset_index->find(file_paths[i]);
+            return entry ? entry->projected_bytes : 0;
+        };
+        std::stable_sort(load_order.begin(), load_order.end(),
+                         [&](size_t a, size_t b) { return projected_bytes(a) > projected_bytes(b); });
+
+        std::vector<std::string> ordered_paths;
+        ordered_paths.reserve(file_paths.size());
+        for (size_t i : load_order) {
+            ordered_paths.push_back(file_paths[i]);
+        }
+        std::vector<float> ordered_loudness;
+        std::vector<LoudnessEnvelope> ordered_envelopes;
+        std::vector<ALuint> ordered_buffers = load_sounds_in_parallel(ordered_paths, extensions, context, 0,
+                                                                      &ordered_loudness, load_options,
+                                                                      &ordered_envelopes);
+        loaded_buffers.resize(file_paths.size());
+        loaded_loudness.resize(file_paths.size());
+        loaded_envelopes.resize(file_paths.size());
+        for (size_t i = 0; i < load_order.size(); i++) {
+            loaded_buffers[load_order[i]] = ordered_buffers[i];
+            loaded_loudness[load_order[i]] = ordered_loudness[i];
+            loaded_envelopes[load_order[i]] = std::move(ordered_envelopes[i]);
+        }
+    } else {
+        loaded_buffers = load_sounds_in_parallel(file_paths, extensions, context, 0, &loaded_loudness, load_options,
+                                                 &loaded_envelopes);
+    }
+
+    size_t next_buffer = 0;
+    std::vector<VariationBuffer *> new_variation_buffers;
+    for (const auto &[sound, files] : sounds) {
+        for (const std::string &file_path : *files) {
+            float loudness = loaded_loudness[next_buffer];
+            LoudnessEnvelope &loudness_envelope = loaded_envelopes[next_buffer];
+            ALuint buffer = loaded_buffers[next_buffer++];
+
+            ALint size, channels, bits, sample_rate;
+            alGetBufferi(buffer, AL_SIZE, &size);
+            alGetBufferi(buffer, AL_CHANNELS, &channels);
+            alGetBufferi(buffer, AL_BITS, &bits);
+            alGetBufferi(buffer, AL_FREQUENCY, &sample_rate);
+            ALint num_samples = (ALint)((int64_t)size * 8 / (channels * bits));
+
+            VariationBuffer &variation_buffer = sound->buffers.emplace_back();
+            variation_buffer.buffer = buffer;
+            variation_buffer.sample_rate = sample_rate;
+            variation_buffer.num_samples = num_samples;
+            variation_buffer.file_path = file_path;
+            variation_buffer.loudness_lufs = loudness;
+            variation_buffer.loudness_envelope = std::move(loudness_envelope);
+            update_loudness_trim(variation_buffer);
+            new_variation_buffers.push_back(&variation_buffer);
+        }
+    }
+    if (software_mixer) {
+        add_to_software_mixer(new_variation_buffers, variation_load_options);
     }
 }
 
 void SoundSystem::init_sound_sources(int num_sources) {
     for (int i = 0; i < num_sources; i++) {
-        ALuint source;
-        alGenSources(1, &source);
-        sound_sources.push_back(source);
+        Voice voice;
+        alGenSources(1, &voice.source);
+        voices.push_back(voice);
+    }
+}
+
+void SoundSystem::enable_software_mixer(unsigned num_threads) {
+    make_context_current();
+    if (software_mixer) {
+        return;
+    }
+    // on loopback the mixer runs at the device's rate, so render_loopback can count its buffered frames as device ones
+    int mixer_sample_rate = loopback ? loopback_format.sample_rate : 48000;
+    software_mixer = std::make_unique<SoftwareMixer>(mixer_sample_rate, 512, 6, num_threads);
+    software_mixer->set_attenuation_curves(attenuation_tables);
+    // a loopback device only plays what render_loopback asks for, which refills the mixer as it goes
+    if (!loopback && extensions.alcSetThreadContext) {
+        software_mixer->start_refill_thread(extensions, context);
+    }
+    effective_bus_gains.resize(bus_graph.get_bus_count());
+    for (BusId bus = 0; bus < bus_graph.get_bus_count(); bus++) {
+        effective_bus_gains[bus] = bus_graph.get_effective_gain(bus);
+    }
+
+    std::vector<VariationBuffer *> variation_buffers;
+    for (auto &[sound_type, sound_type_buffers] : sound_buffers) {
+        for (VariationBuffer &variation_buffer : sound_type_buffers.buffers) {
+            variation_buffers.push_back(&variation_buffer);
+        }
+    }
+    for (SoundTypeBuffers &event_buffer : event_buffers) {
+        for (VariationBuffer &variation_buffer : event_buffer.buffers) {
+            variation_buffers.push_back(&variation_buffer);
+        }
     }
+    add_to_software_mixer(variation_buffers, variation_load_options);
 }
 
-void SoundSystem::queue_sound(SoundType type, glm::vec3 position) { sound_to_play_queue.push({type, position}); }
+void SoundSystem::add_to_software_mixer(const std::vector<VariationBuffer *> &variation_buffers,
+                                        const LoadOptions &options) {
+    // decoded with the options the buffers were, so the trimmed silence, loudness trims and scheduled offsets agree
+    std::vector<std::string> file_paths;
+    for (const VariationBuffer *variation_buffer : variation_buffers) {
+        file_paths.push_back(variation_buffer->file_path);
+    }
+    std::vector<PcmBuffer> pcm = load_sounds_into_pcm_in_parallel(file_paths, extensions, context, 0, options);
+    for (size_t i = 0; i < variation_buffers.size(); i++) {
+        variation_buffers[i]->mixer_buffer_id =
+            software_mixer->add_buffer(std::move(pcm[i]), variation_buffers[i]->loudness_envelope);
+    }
+}
 
-void SoundSystem::play_all_sounds() {
-    while (!sound_to_play_queue.empty()) {
-        QueuedSound queued_sound = sound_to_play_queue.front();
-        sound_to_play_queue.pop();
+bool SoundSystem::is_software_mixer_enabled() const { return software_mixer != nullptr; }
 
-        ALuint source = get_available_source();
-        if (source != 0) {
-            ALuint buffer = sound_buffers[queued_sound.type];
-            alSourcei(source, AL_BUFFER, buffer);
-            alSource3f(source, AL_POSITION, queued_sound.position.x, queued_sound.position.y, queued_sound.position.z);
-            alSourcePlay(source);
+void SoundSystem::queue_sound(SoundType type, glm::vec3 position) {
+    // recorded under the same lock as the push, so a replay queues sounds from several threads in the same order
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (trace_recorder) {
+        trace_recorder->record_queue_sound((uint32_t)type, position);
+    }
+    sound_to_play_queue.push({type, position});
+}
+
+void SoundSystem::queue_event(SoundEventId event, glm::vec3 position) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (trace_recorder) {
+        trace_recorder->record_queue_event(event, position);
+    }
+    event_queue.push_back({event, position});
+}
+
+void SoundSystem::queue_sound_at(SoundType type, glm::vec3 position, int64_t device_time_ns) {
+    int64_t now_ns = trace_recorder ? get_device_clock_time() : 0;
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (trace_recorder) {
+        // the device clock of a replay starts somewhere else, so only how far ahead the sound was is kept
+        trace_recorder->record_queue_sound_at((uint32_t)type, position, (float)(device_time_ns - now_ns) / 1e9f);
+    }
+    scheduled_sounds.push({type, position, device_time_ns});
+}
+
+void SoundSystem::sync_server_clock(int64_t server_time_ns, int64_t round_trip_ns) {
+    int64_t now_ns = get_device_clock_time();
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    server_clock.add_sample(server_time_ns, round_trip_ns, now_ns);
+}
+
+void SoundSystem::queue_server_sound(SoundType type, glm::vec3 position, int64_t server_time_ns,
+                                     NetworkEventId event_id) {
+    int64_t now_ns = get_device_clock_time();
+    int64_t device_time_ns;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!remember_network_event(event_id, now_ns)) {
+            return;
+        }
+        device_time_ns = server_clock.is_synced() ? server_clock.to_local_time(server_time_ns) : now_ns;
+        if (trace_recorder) {
+            trace_recorder->record_queue_sound_at((uint32_t)type, position, (float)(device_time_ns - now_ns) / 1e9f);
+        }
+        scheduled_sounds.push({type, position, device_time_ns});
+    }
+}
+
+void SoundSystem::queue_predicted_sound(SoundType type, glm::vec3 position, NetworkEventId event_id) {
+    int64_t now_ns = get_device_clock_time();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!remember_network_event(event_id, now_ns)) {
+            return; // the server's copy got here first
+        }
+    }
+    queue_sound(type, position);
+}
+
+void SoundSystem::set_network_event_window(int64_t window_ns) {
+    assert(window_ns >= 0);
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    network_event_window_ns = window_ns;
+}
+
+bool SoundSystem::remember_network_event(NetworkEventId event_id, int64_t now_ns) {
+    // ids are forgotten in the order they were seen, so the map stays as small as the window
+    while (!network_event_order.empty() && now_ns - network_event_order.front().first > network_event_window_ns) {
+        network_event_ids.erase(network_event_order.front().second);
+        network_event_order.pop();
+    }
+    if (!network_event_ids.insert(event_id).second) {
+        return false;
+    }
+    network_event_order.push({now_ns, event_id});
+    return true;
+}
+
+void SoundSystem::set_schedule_lookahead(int64_t lookahead_ns) {
+    assert(lookahead_ns >= 0);
+    schedule_lookahead_ns = lookahead_ns;
+}
+
+int64_t SoundSystem::get_device_clock_time() {
+    if (loopback) {
+        return rendered_frames * 1'000'000'000 / loopback_format.sample_rate;
+    }
+    if (extensions.alcGetInteger64vSOFT) {
+        ALCint64SOFT device_clock_ns;
+        extensions.alcGetInteger64vSOFT(device, ALC_DEVICE_CLOCK_SOFT, 1, &device_clock_ns);
+        return device_clock_ns;
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+BusId SoundSystem::create_bus(BusId parent) { return bus_graph.create_bus(parent); }
+
+void SoundSystem::set_bus_gain(BusId bus, float gain) { bus_graph.set_gain(bus, gain); }
+
+float SoundSystem::get_bus_gain(BusId bus) const { return bus_graph.get_gain(bus); }
+
+void SoundSystem::set_source_bus(const std::string &source_name, BusId bus) {
+    make_context_current();
+    Voice &voice = get_named_voice(source_name);
+    uint32_t voice_index = (uint32_t)(&voice - voices.data());
+    bus_graph.remove_voice(voice.bus, voice_index);
+    bus_graph.add_voice(bus, voice_index);
+    voice.bus = bus;
+    alSourcef(voice.source, AL_GAIN, voice.get_gain(bus_graph.get_effective_gain(bus)));
+}
+
+/**
+ * Folds the bus gain changes made since the last frame into the gains of the voices underneath them, buses which
+ * didn't change cost nothing
+ */
+void SoundSystem::apply_bus_gains() {
+    bool deferred = false;
+    bus_graph.propagate([&](BusId bus) {
+        const std::vector<uint32_t> &bus_voices = bus_graph.get_voices(bus);
+        if (!bus_voices.empty() && !deferred && extensions.alDeferUpdatesSOFT) {
+            extensions.alDeferUpdatesSOFT();
+            deferred = true;
+        }
+        float effective_gain = bus_graph.get_effective_gain(bus);
+        for (uint32_t voice_index : bus_voices) {
+            const Voice &voice = voices[voice_index];
+            alSourcef(voice.source, AL_GAIN, voice.get_gain(effective_gain));
+        }
+        if (software_mixer) {
+            effective_bus_gains.resize(bus_graph.get_bus_count(), 1.0f);
+            effective_bus_gains[bus] = effective_gain;
+        }
+    });
+    if (deferred) {
+        extensions.alProcessUpdatesSOFT();
+    }
+}
+
+ReverbZoneId SoundSystem::add_reverb_zone(const ReverbZone &zone) {
+    make_context_current();
+    if (!extensions.efx) {
+        throw std::runtime_error("reverb zones need ALC_EXT_EFX which the device doesn't support");
+    }
+    if (!reverb_zones) {
+        ALCint num_sends = 0;
+        alcGetIntegerv(device, ALC_MAX_AUXILIARY_SENDS, 1, &num_sends);
+        reverb_zones = std::make_unique<ReverbZoneSystem>(extensions, num_reverb_slots, num_sends);
+    }
+    return reverb_zones->add_zone(zone);
+}
+
+void SoundSystem::set_occlusion_query(OcclusionQuery query, const OcclusionSettings &settings) {
+    make_context_current();
+    if (!extensions.efx) {
+        throw std::runtime_error("occlusion needs ALC_EXT_EFX which the device doesn't support");
+    }
+    assert(settings.rays_per_frame > 0);
+    occlusion_query = std::move(query);
+    occlusion_settings = settings;
+    for (Voice &voice : voices) {
+        if (!voice.named && !voice.direct_filter) {
+            extensions.alGenFilters(1, &voice.direct_filter);
+            extensions.alFilteri(voice.direct_filter, AL_FILTER_TYPE, AL_FILTER_LOWPASS);
+        }
+    }
+}
+
+/**
+ * Asks the game about at most rays_per_frame voices, ones which just started go first so they don't play unmuffled
+ * for long, the rest of the budget continues the round robin over the playing voices
+ */
+void SoundSystem::update_occlusion() {
+    size_t budget = (size_t)occlusion_settings.rays_per_frame;
+    occlusion_voices.clear();
+
+    for (uint32_t voice_index = 0; voice_index < voices.size() && occlusion_voices.size() < budget; voice_index++) {
+        if (voices[voice_index].active && voices[voice_index].occlusion_stale) {
+            occlusion_voices.push_back(voice_index);
+        }
+    }
+    for (size_t visited = 0; visited < voices.size() && occlusion_voices.size() < budget; visited++) {
+        occlusion_cursor = (occlusion_cursor + 1) % voices.size();
+        const Voice &voice = voices[occlusion_cursor];
+        if (voice.active && voice.direct_filter && !voice.occlusion_stale) {
+            occlusion_voices.push_back((uint32_t)occlusion_cursor);
+        }
+    }
+    if (occlusion_voices.empty()) {
+        return;
+    }
+
+    occlusion_rays.clear();
+    for (uint32_t voice_index : occlusion_voices) {
+        glm::vec3 position = voices[voice_index].position;
+        occlusion_rays.push_back({get_nearest_listener(position).position, position});
+    }
+    occlusion_results.assign(occlusion_rays.size(), 0.0f);
+    occlusion_query(occlusion_rays, occlusion_results);
+
+    for (size_t i = 0; i < occlusion_voices.size(); i++) {
+        Voice &voice = voices[occlusion_voices[i]];
+        voice.occlusion = glm::clamp(occlusion_results[i], 0.0f, 1.0f);
+        voice.occlusion_stale = false;
+        // skip the driver calls when the result barely moved
+        if (std::fabs(voice.occlusion - voice.applied_occlusion) > 0.01f) {
+            apply_direct_filter(voice);
+        }
+    }
+}
+
+void SoundSystem::apply_direct_filter(Voice &voice) {
+    float gain = 1.0f - voice.occlusion * occlusion_settings.max_gain_reduction;
+    float high_frequency_gain =
+        (1.0f - voice.occlusion * occlusion_settings.max_high_frequency_reduction) * voice.curve_values.low_pass;
+    extensions.alFilterf(voice.direct_filter, AL_LOWPASS_GAIN, gain);
+    extensions.alFilterf(voice.direct_filter, AL_LOWPASS_GAINHF, high_frequency_gain);
+    // the filter's properties are copied into the source when it's attached
+    alSourcei(voice.source, AL_DIRECT_FILTER, (ALint)voice.direct_filter);
+    voice.applied_occlusion = voice.occlusion;
+    voice.applied_low_pass = voice.curve_values.low_pass;
+}
+
+AttenuationCurveId SoundSystem::add_attenuation_curve(const AttenuationCurveSet &curves) {
+    AttenuationCurveId curve = attenuation_tables.add(curves);
+    if (software_mixer) {
+        software_mixer->set_attenuation_curves(attenuation_tables);
+    }
+    return curve;
+}
+
+void SoundSystem::apply_attenuation(Voice &voice, const SoundTypeBuffers &sound) {
+    voice.attenuation_curve = sound.attenuation_curve;
+    bool uses_curve = voice.attenuation_curve != no_attenuation_curve;
+    if (uses_curve && voice.attenuation_curve >= attenuation_tables.size()) {
+        std::cerr << "A sound uses an attenuation curve which wasn't added." << std::endl;
+        voice.attenuation_curve = no_attenuation_curve;
+        uses_curve = false;
+    }
+
+    SoundAttenuation attenuation = sound.attenuation;
+    if (uses_curve && !extensions.source_distance_model) {
+        // without a per source distance model a rolloff of 0 turns OpenAL's attenuation off
+        attenuation.rolloff_factor = 0.0f;
+    }
+    if (extensions.source_distance_model && voice.distance_model_none != uses_curve) {
+        alSourcei(voice.source, AL_DISTANCE_MODEL, uses_curve ? AL_NONE : AL_INVERSE_DISTANCE_CLAMPED);
+        voice.distance_model_none = uses_curve;
+    }
+    if (voice.attenuation != attenuation) {
+        voice.attenuation = attenuation;
+        alSourcef(voice.source, AL_REFERENCE_DISTANCE, attenuation.reference_distance);
+        alSourcef(voice.source, AL_MAX_DISTANCE, attenuation.max_distance);
+        alSourcef(voice.source, AL_ROLLOFF_FACTOR, attenuation.rolloff_factor);
+    }
+
+    voice.curve_values = {};
+    if (uses_curve) {
+        float distance = glm::distance(voice.position, get_nearest_listener(voice.position).position);
+        voice.curve_values = attenuation_tables.evaluate(voice.attenuation_curve, distance);
+        if (extensions.efx && !voice.direct_filter) {
+            extensions.alGenFilters(1, &voice.direct_filter);
+            extensions.alFilteri(voice.direct_filter, AL_FILTER_TYPE, AL_FILTER_LOWPASS);
+        }
+        if (reverb_zones && !voice.send_filter) {
+            extensions.alGenFilters(1, &voice.send_filter);
+            extensions.alFilteri(voice.send_filter, AL_FILTER_TYPE, AL_FILTER_LOWPASS);
+        }
+    }
+    if (voice.direct_filter && std::fabs(voice.curve_values.low_pass - voice.applied_low_pass) > 0.01f) {
+        apply_direct_filter(voice);
+    }
+}
+
+/**
+ * Voices with a curve send to the reverb through their send filter, whose gain is the curve's reverb send, the
+ * filter's properties are copied when it's attached so it has to be attached again after every change
+ */
+void SoundSystem::route_reverb_sends(Voice &voice) {
+    ALuint send_filter = AL_FILTER_NULL;
+    if (voice.attenuation_curve != no_attenuation_curve && voice.send_filter) {
+        extensions.alFilterf(voice.send_filter, AL_LOWPASS_GAIN, voice.curve_values.reverb_send);
+        send_filter = voice.send_filter;
+    }
+    reverb_zones->route_source(voice.source, voice.position, send_filter);
+    voice.applied_reverb_send = voice.curve_values.reverb_send;
+}
+
+/**
+ * Looks up the curves of every playing voice which has one in one batch, only the values which moved noticeably are
+ * sent to OpenAL
+ */
+void SoundSystem::update_attenuation_curves() {
+    curve_voices.clear();
+    curve_ids.clear();
+    curve_distances.clear();
+    for (uint32_t voice_index = 0; voice_index < voices.size(); voice_index++) {
+        const Voice &voice = voices[voice_index];
+        if (voice.active && voice.attenuation_curve != no_attenuation_curve) {
+            curve_voices.push_back(voice_index);
+            curve_ids.push_back(voice.attenuation_curve);
+            curve_distances.push_back(glm::distance(voice.position, get_nearest_listener(voice.position).position));
+        }
+    }
+    if (curve_voices.empty()) {
+        return;
+    }
+    curve_gains.resize(curve_voices.size());
+    curve_low_passes.resize(curve_voices.size());
+    curve_reverb_sends.resize(curve_voices.size());
+    attenuation_tables.evaluate(curve_ids, curve_distances, curve_gains, curve_low_passes, curve_reverb_sends);
+
+    if (extensions.alDeferUpdatesSOFT) {
+        extensions.alDeferUpdatesSOFT();
+    }
+    for (size_t i = 0; i < curve_voices.size(); i++) {
+        Voice &voice = voices[curve_voices[i]];
+        if (std::fabs(curve_gains[i] - voice.curve_values.gain) > 1e-3f) {
+            voice.curve_values.gain = curve_gains[i];
+            alSourcef(voice.source, AL_GAIN, voice.get_gain(bus_graph.get_effective_gain(voice.bus)));
+        }
+        voice.curve_values.low_pass = curve_low_passes[i];
+        voice.curve_values.reverb_send = curve_reverb_sends[i];
+        if (voice.direct_filter && std::fabs(voice.curve_values.low_pass - voice.applied_low_pass) > 0.01f) {
+            apply_direct_filter(voice);
+        }
+        if (reverb_zones && std::fabs(voice.curve_values.reverb_send - voice.applied_reverb_send) > 0.01f) {
+            route_reverb_sends(voice);
+        }
+    }
+    if (extensions.alProcessUpdatesSOFT) {
+        extensions.alProcessUpdatesSOFT();
+    }
+}
+
+void SoundSystem::add_ducking_rule(const DuckingRule &rule) {
+    assert(rule.sidechain < bus_graph.get_bus_count() && rule.target < bus_graph.get_bus_count());
+    bus_ducker.add_rule(rule);
+}
+
+/**
+ * Follows the envelope of the buffer through the playback position worked out from when the voice started and its
+ * pitch, so a sound with a loud attack and a long quiet tail only ducks for the attack. Streamed, procedural and ADPCM
+ * sounds have no envelope and count as their integrated loudness.
+ */
+float SoundSystem::get_current_loudness(const Voice &voice) const {
+    const LoudnessEnvelope *envelope = voice.loudness_envelope;
+    if (!envelope || envelope->empty()) {
+        return voice.loudness;
+    }
+    double elapsed = std::max(std::chrono::duration<double>(frame_time - voice.start_time).count(), 0.0);
+    double frame = voice.start_frame + elapsed * voice.frames_per_second;
+    if (voice.looping) {
+        frame = std::fmod(frame, (double)envelope->block_gains.size() * envelope->block_frames);
+    }
+    return envelope->get_gain((size_t)frame) * voice.loudness_trim;
+}
+
+/**
+ * Estimates how loud each bus is from what is playing on it, the gain of each voice times the loudness of its buffer
+ * where it has got to, then runs the ducking envelopes on that, no driver queries are needed
+ */
+void SoundSystem::update_ducking() {
+    float delta_time =
+        ducking_started ? std::chrono::duration<float>(frame_time - last_ducking_update).count() : 0.0f;
+    last_ducking_update = frame_time;
+    ducking_started = true;
+
+    bus_loudness.assign(bus_graph.get_bus_count(), 0.0f);
+    for (BusId bus = 0; bus < bus_graph.get_bus_count(); bus++) {
+        for (uint32_t voice_index : bus_graph.get_voices(bus)) {
+            const Voice &voice = voices[voice_index];
+            if (voice.active) {
+                bus_loudness[bus] += voice.base_gain * get_current_loudness(voice);
+            }
+        }
+    }
+    if (software_mixer) {
+        software_mixer->accumulate_bus_loudness(bus_loudness);
+    }
+    // children always have larger ids than their parents, so going backwards sums each subtree before it's used
+    for (BusId bus = (BusId)bus_loudness.size() - 1; bus > buses::master; bus--) {
+        bus_loudness[bus_graph.get_parent(bus)] += bus_loudness[bus];
+    }
+
+    bus_ducker.update(bus_loudness, delta_time, bus_graph);
+}
+
+const std::vector<VoiceHandle> &SoundSystem::play_all_sounds() {
+    make_context_current();
+    started_voices.clear();
+    // on a loopback device time only passes as audio is rendered, so cooldowns and ducking replay the same way
+    if (loopback) {
+        std::chrono::nanoseconds rendered_time(get_device_clock_time());
+        frame_time = std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(rendered_time));
+    } else {
+        frame_time = std::chrono::steady_clock::now();
+    }
+    // before reaping, so a stream which ran dry gets restarted rather than counted as finished
+    if (!voice_index_to_stream.empty()) {
+        update_streams();
+    }
+    reap_finished_voices();
+    if (bus_ducker.has_rules()) {
+        update_ducking();
+    }
+    apply_bus_gains();
+
+    // when the slots move to other zones the voices already playing need to follow
+    if (reverb_zones && reverb_zones->update_listener(listener_state.position)) {
+        for (Voice &voice : voices) {
+            if (voice.active && !voice.named) {
+                route_reverb_sends(voice);
+            }
+        }
+    }
+
+    // take everything queued so far in one go so other threads can keep queueing while the sounds start
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        // recorded where the queues are taken, so a sound queued on another thread lands in the same frame on replay
+        if (trace_recorder) {
+            trace_recorder->record_play_all_sounds();
+        }
+        std::swap(sound_to_play_queue, draining_queue);
+        std::swap(event_queue, draining_events);
+    }
+    while (!draining_queue.empty()) {
+        QueuedSound queued_sound = draining_queue.front();
+        draining_queue.pop();
+
+        started_voices.push_back(start_sound(queued_sound.type, queued_sound.position));
+    }
+    for (const QueuedEvent &queued_event : draining_events) {
+        if (queued_event.event >= event_buffers.size()) {
+            std::cerr << "You tried to play a sound event which wasn't loaded." << std::endl;
+            started_voices.push_back({});
+            continue;
+        }
+        started_voices.push_back(start_sound(event_buffers[queued_event.event], queued_event.position));
+    }
+    draining_events.clear();
+
+    drain_scheduled_sounds();
+
+    if (attenuation_tables.size() > 0) {
+        update_attenuation_curves();
+    }
+    if (occlusion_query) {
+        update_occlusion();
+    }
+
+    if (software_mixer) {
+        if (split_listeners.empty()) {
+            software_mixer->set_listener(listener_state);
+        } else {
+            software_mixer->set_listeners(split_listeners);
+        }
+        software_mixer->set_bus_gains(effective_bus_gains);
+        software_mixer->update();
+    }
+
+    check_frame_al_error();
+    frame_index++;
+    return started_voices;
+}
+
+void SoundSystem::update_streams() {
+    for (auto it = voice_index_to_stream.begin(); it != voice_index_to_stream.end();) {
+        if (it->second->update()) {
+            ++it;
+        } else {
+            // the whole file has played, the stopped source gets reaped like any other
+            it = voice_index_to_stream.erase(it);
+        }
+    }
+}
+
+void SoundSystem::drain_scheduled_sounds() {
+    // when the device can delay the start itself we hand sounds over ahead of time, otherwise we wait until they are
+    // due and make up for the lateness with a sample offset
+    bool device_delays_start = extensions.alSourcePlayAtTimeSOFT && !software_mixer;
+    int64_t now_ns = get_device_clock_time();
+    int64_t horizon_ns = device_delays_start ? now_ns + schedule_lookahead_ns : now_ns;
+
+    due_scheduled_sounds.clear();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        while (!scheduled_sounds.empty() && scheduled_sounds.top().device_time_ns <= horizon_ns) {
+            due_scheduled_sounds.push_back(scheduled_sounds.top());
+            scheduled_sounds.pop();
+        }
+    }
+
+    for (const ScheduledSound &scheduled_sound : due_scheduled_sounds) {
+        int64_t due_ns = scheduled_sound.device_time_ns;
+        VoiceHandle handle;
+        if (due_ns > now_ns) {
+            handle = start_sound(scheduled_sound.type, scheduled_sound.position, 0, due_ns);
         } else {
-            std::cout << "bad source" << std::endl;
+            handle = start_sound(scheduled_sound.type, scheduled_sound.position, now_ns - due_ns);
+        }
+        if (handle.is_valid()) {
+            started_voices.push_back(handle);
+        }
+    }
+}
+
+void SoundSystem::find_voices_in_radius(glm::vec3 center, float radius, std::vector<VoiceHandle> &handles) const {
+    nearby_voices.clear();
+    voice_grid.find_in_radius(center, radius, nearby_voices);
+    handles.clear();
+    for (uint32_t voice_index : nearby_voices) {
+        handles.push_back({voice_index, voices[voice_index].generation});
+    }
+}
+
+void SoundSystem::find_nearest_voices(glm::vec3 center, size_t count, std::vector<VoiceHandle> &handles) const {
+    voice_grid.find_nearest(center, count, nearby_voices);
+    handles.clear();
+    for (uint32_t voice_index : nearby_voices) {
+        handles.push_back({voice_index, voices[voice_index].generation});
+    }
+}
+
+void SoundSystem::update_emitters(std::span<const VoiceHandle> handles, std::span<const glm::vec3> positions,
+                                  std::span<const glm::vec3> velocities) {
+    make_context_current();
+    assert(handles.size() == positions.size() && handles.size() == velocities.size());
+
+    if (extensions.alDeferUpdatesSOFT) {
+        extensions.alDeferUpdatesSOFT();
+    }
+
+    for (size_t i = 0; i < handles.size(); i++) {
+        const VoiceHandle &handle = handles[i];
+        if (handle.index >= voices.size()) {
+            continue;
         }
+        Voice &voice = voices[handle.index];
+        if (!voice.active || voice.generation != handle.generation) {
+            continue; // the sound has finished
+        }
+        voice.position = positions[i];
+        voice.velocity = velocities[i];
+        voice_grid.move(handle.index, positions[i]);
+        glm::vec3 position = get_source_position(positions[i]);
+        glm::vec3 velocity = get_source_velocity(positions[i], velocities[i]);
+        alSource3f(voice.source, AL_POSITION, position.x, position.y, position.z);
+        alSource3f(voice.source, AL_VELOCITY, velocity.x, velocity.y, velocity.z);
+    }
+
+    if (extensions.alProcessUpdatesSOFT) {
+        extensions.alProcessUpdatesSOFT();
     }
 }
 
-ALuint SoundSystem::get_available_source() {
-    for (ALuint source : sound_sources) {
+/**
+ * @param late_by_ns how long ago the sound should have started, it starts that far into the buffer
+ * @param play_at_device_time_ns when non zero the device delays the start until this time on its clock
+ * @return the voice the sound is playing on, invalid if it didn't start
+ */
+VoiceHandle SoundSystem::start_sound(SoundType type, glm::vec3 position, int64_t late_by_ns,
+                                int64_t play_at_device_time_ns) {
+    auto sound_type_buffers_it = sound_buffers.find(type);
+    if (sound_type_buffers_it == sound_buffers.end()) {
+        std::cerr << "You tried to play a sound type which wasn't loaded." << std::endl;
+        return {};
+    }
+    return start_sound(sound_type_buffers_it->second, position, late_by_ns, play_at_device_time_ns);
+}
+
+VoiceHandle SoundSystem::start_sound(SoundTypeBuffers &sound_type_buffers, glm::vec3 position, int64_t late_by_ns,
+                                     int64_t play_at_device_time_ns) {
+    if (sound_type_buffers.cooldown > 0 && sound_type_buffers.started) {
+        float since_last_start = std::chrono::duration<float>(frame_time - sound_type_buffers.last_start).count();
+        if (since_last_start < sound_type_buffers.cooldown) {
+            return {};
+        }
+    }
+    if (sound_type_buffers.max_instances != 0) {
+        size_t num_instances = sound_type_buffers.num_instances;
+        if (software_mixer) {
+            num_instances += software_mixer->get_group_voice_count(sound_type_buffers.mixer_group);
+        }
+        if (num_instances >= sound_type_buffers.max_instances) {
+            return {};
+        }
+    }
+
+    // pitch and gain are source properties, so varying them costs nothing compared to baking new buffers
+    std::uniform_int_distribution<size_t> variation_distribution(0, sound_type_buffers.buffers.size() - 1);
+    std::uniform_real_distribution<float> pitch_distribution(sound_type_buffers.min_pitch,
+                                                             sound_type_buffers.max_pitch);
+    std::uniform_real_distribution<float> gain_distribution(sound_type_buffers.min_gain, sound_type_buffers.max_gain);
+
+    const VariationBuffer &variation_buffer =
+        sound_type_buffers.buffers[variation_distribution(random_number_generator)];
+    float pitch = pitch_distribution(random_number_generator);
+    float gain = gain_distribution(random_number_generator);
+
+    ALint sample_offset = 0;
+    if (late_by_ns > 0) {
+        // the buffer advances pitch times faster than the clock
+        sample_offset = (ALint)((double)late_by_ns * variation_buffer.sample_rate * pitch / 1e9);
+        if (sample_offset >= variation_buffer.num_samples) {
+            return {}; // the sound would already be over
+        }
+    }
+
+    // a variation the mixer doesn't have plays on a pooled source instead
+    if (software_mixer && variation_buffer.mixer_buffer_id != no_mixer_buffer) {
+        software_mixer->play(variation_buffer.mixer_buffer_id, position, gain * variation_buffer.loudness_trim, pitch,
+                             sound_type_buffers.bus, (uint32_t)sample_offset, sound_type_buffers.attenuation,
+                             sound_type_buffers.attenuation_curve, sound_type_buffers.mixer_group);
+        sound_type_buffers.last_start = frame_time;
+        sound_type_buffers.started = true;
+        return {}; // mixer voices can't be moved
+    }
+
+    uint32_t voice_index = get_available_voice();
+    if (voice_index == UINT32_MAX) {
+        voice_index = steal_voice(sound_type_buffers.priority);
+    }
+    if (voice_index == UINT32_MAX) {
+        std::cout << "bad source" << std::endl;
+        return {};
+    }
+    sound_type_buffers.num_instances++;
+    sound_type_buffers.last_start = frame_time;
+    sound_type_buffers.started = true;
+
+    Voice &voice = voices[voice_index];
+    voice.active = true;
+    voice.priority = sound_type_buffers.priority;
+    voice.sound = &sound_type_buffers;
+    voice.base_gain = gain;
+    voice.loudness = variation_buffer.loudness;
+    voice.loudness_trim = variation_buffer.loudness_trim;
+    voice.loudness_envelope = &variation_buffer.loudness_envelope;
+    // sounds the device delays are counted from now, they're at most the schedule lookahead early
+    voice.start_time = frame_time;
+    voice.start_frame = sample_offset;
+    voice.frames_per_second = (double)variation_buffer.sample_rate * pitch;
+    voice.bus = sound_type_buffers.bus;
+    voice.position = position;
+    voice.velocity = glm::vec3(0.0f);
+    voice_grid.insert(voice_index, position);
+    // a reused voice starts out unoccluded rather than with the last sound's occlusion, it's measured again soon
+    voice.occlusion = 0.0f;
+    voice.occlusion_stale = voice.direct_filter != 0;
+    bus_graph.add_voice(voice.bus, voice_index);
+    ALuint source = voice.source;
+
+    alSourcei(source, AL_BUFFER, variation_buffer.buffer);
+    alSourcef(source, AL_PITCH, pitch);
+    apply_attenuation(voice, sound_type_buffers);
+    if (voice.direct_filter && voice.applied_occlusion != voice.occlusion) {
+        apply_direct_filter(voice);
+    }
+    alSourcef(source, AL_GAIN, voice.get_gain(bus_graph.get_effective_gain(voice.bus)));
+    glm::vec3 source_position = get_source_position(position);
+    alSource3f(source, AL_POSITION, source_position.x, source_position.y, source_position.z);
+    // a still sound is still moving relative to a moving listener when it's heard in that listener's space
+    glm::vec3 source_velocity = get_source_velocity(position, voice.velocity);
+    alSource3f(source, AL_VELOCITY, source_velocity.x, source_velocity.y, source_velocity.z);
+    if (reverb_zones) {
+        route_reverb_sends(voice);
+    }
+    if (sample_offset > 0) {
+        alSourcei(source, AL_SAMPLE_OFFSET, sample_offset);
+    }
+
+    if (play_at_device_time_ns != 0) {
+        extensions.alSourcePlayAtTimeSOFT(source, play_at_device_time_ns);
+    } else {
+        alSourcePlay(source);
+    }
+
+    return {voice_index, voice.generation};
+}
+
+uint32_t SoundSystem::get_available_voice() {
+    for (uint32_t i = 0; i < voices.size(); i++) {
+        if (!voices[i].active && !voices[i].named) {
+            return i;
+        }
+    }
+    return UINT32_MAX; // no available voice
+}
+
+/**
+ * Frees up the voices whose sound has finished since the last call, this is the only place the pool queries the
+ * driver for source states, so it happens once per voice per frame
+ */
+void SoundSystem::reap_finished_voices() {
+    for (uint32_t voice_index = 0; voice_index < voices.size(); voice_index++) {
+        Voice &voice = voices[voice_index];
+        if (!voice.active) {
+            continue;
+        }
         ALint state;
-        alGetSourcei(source, AL_SOURCE_STATE, &state);
+        alGetSourcei(voice.source, AL_SOURCE_STATE, &state);
         if (state != AL_PLAYING) {
-            return source;
+            release_voice(voice_index);
         }
     }
-    return 0; // no available source
+}
+
+void SoundSystem::release_voice(uint32_t voice_index) {
+    Voice &voice = voices[voice_index];
+    voice.active = false;
+    voice.generation++;
+    // named sources stay on their bus while they're idle
+    if (!voice.named) {
+        bus_graph.remove_voice(voice.bus, voice_index);
+        voice_grid.remove(voice_index);
+    }
+    if (voice.sound) {
+        voice.sound->num_instances--;
+        voice.sound = nullptr;
+    }
+}
+
+uint32_t SoundSystem::steal_voice(uint8_t priority) {
+    uint32_t victim = UINT32_MAX;
+    for (uint32_t i = 0; i < voices.size(); i++) {
+        const Voice &voice = voices[i];
+        if (voice.active && !voice.named && voice.priority < priority &&
+            (victim == UINT32_MAX || voice.priority < voices[victim].priority)) {
+            victim = i;
+        }
+    }
+    if (victim != UINT32_MAX) {
+        alSourceStop(voices[victim].source);
+        release_voice(victim);
+    }
+    return victim;
 }
 // NEW
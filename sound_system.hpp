@@ -2,13 +2,40 @@
 #define SOUND_SYSTEM_HPP
 
 #include <AL/al.h>
+#include <AL/alc.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <random>
+#include <span>
 #include <string>
+#include <utility>
+#include <vector>
 #include <glm/glm.hpp>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "sbpt_generated_includes.hpp"
+#include "openal_extensions.hpp"
+#include "listener_state.hpp"
+#include "software_mixer.hpp"
+#include "mixer_bus.hpp"
+#include "bus_ducking.hpp"
+#include "reverb_zones.hpp"
+#include "occlusion.hpp"
+#include "procedural_audio.hpp"
+#include "sound_events.hpp"
+#include "attenuation_curves.hpp"
+#include "sound_stream.hpp"
+#include "asset_index.hpp"
+#include "load_sound_file.hpp"
+#include "sound_trace.hpp"
+#include "server_clock.hpp"
+#include "voice_spatial_hash.hpp"
 
 // Structure representing a sound to be queued
 struct QueuedSound {
@@ -16,40 +43,495 @@ struct QueuedSound {
     glm::vec3 position;
 };
 
+// A sound which should start at a specific time on the device clock
+struct ScheduledSound {
+    SoundType type;
+    glm::vec3 position;
+    int64_t device_time_ns;
+};
+
+// A set of interchangeable files for one sound type, every time the sound is played one of them is picked at random
+// and played with a pitch and gain drawn from the given ranges, so that repeated sounds don't sound identical
+struct SoundVariations {
+    std::vector<std::string> files;
+    float min_pitch = 1.0f;
+    float max_pitch = 1.0f;
+    float min_gain = 1.0f;
+    float max_gain = 1.0f;
+    BusId bus = buses::sfx;
+};
+
+// Identifies something which happened in a networked game, the server and the client which predicted it give it the
+// same id
+using NetworkEventId = uint64_t;
+
+struct QueuedEvent {
+    SoundEventId event;
+    glm::vec3 position;
+};
+
+// The output of a system which renders into memory instead of playing on a device, only mono and stereo are supported
+struct LoopbackFormat {
+    int sample_rate = 48000;
+    int channels = 2;
+};
+
+// Identifies a sound started by play_all_sounds, it goes stale once the sound has finished and its source is reused
+struct VoiceHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+    bool is_valid() const { return index != UINT32_MAX; }
+};
+
+/**
+ * How often OpenAL's error state is read, every read is a round trip into the driver which takes a lock.
+ *  - checked: after every call which can fail
+ *  - deferred: once per play_all_sounds, an error is reported against the frame it happened in
+ *  - off: never
+ */
+enum class ErrorCheckMode { checked, deferred, off };
+
+// define this before including to change the mode systems start out in
+#ifndef SOUND_SYSTEM_DEFAULT_ERROR_CHECK_MODE
+#ifdef NDEBUG
+#define SOUND_SYSTEM_DEFAULT_ERROR_CHECK_MODE ErrorCheckMode::deferred
+#else
+#define SOUND_SYSTEM_DEFAULT_ERROR_CHECK_MODE ErrorCheckMode::checked
+#endif
+#endif
+
+/**
+ * Each system owns its own device and context, so several systems can exist side by side. Every method makes the
+ * system's context current for the calling thread before touching OpenAL, with ALC_EXT_thread_local_context this
+ * doesn't affect other threads.
+ *
+ * Thread safety: queue_sound, queue_sound_at and the network sound methods may be called from any thread at any
+ * time. Everything else must only be called from one thread at a time, normally the game thread. Worker threads which
+ * want to use OpenAL objects of this system, eg to upload buffers, should hold a bind_to_this_thread binding while they
+ * do.
+ */
 class SoundSystem {
   public:
     // NEW
     SoundSystem(int num_sources, std::unordered_map<SoundType, std::string> &sound_type_to_file);
+    /**
+     * @param asset_index if given the files are checked against it before any are decoded, so a bad file fails the
+     * load straight away, and the largest files are loaded first
+     * @param load_options used for these files and any loaded later, see set_load_options
+     * @param loopback if given nothing is played, the mix is pulled out with render_loopback instead
+     */
+    SoundSystem(int num_sources, std::unordered_map<SoundType, SoundVariations> &sound_type_to_variations,
+                const AssetIndex *asset_index = nullptr, const LoadOptions &load_options = {},
+                const LoopbackFormat *loopback = nullptr);
+    /**
+     * Loads the events from a table made with write_sound_event_table, they're then played with queue_event using
+     * their index in the table
+     */
+    SoundSystem(int num_sources, const std::string &event_table_path, const AssetIndex *asset_index = nullptr,
+                const LoadOptions &load_options = {}, const LoopbackFormat *loopback = nullptr);
     void queue_sound(SoundType type, glm::vec3 position);
-    void play_all_sounds();
+    void queue_event(SoundEventId event, glm::vec3 position);
+    /**
+     * Schedules a sound to start at the given time on the device clock, see get_device_clock_time. Sounds which are
+     * already late when they are drained start part way through so that they still line up with the timeline.
+     */
+    void queue_sound_at(SoundType type, glm::vec3 position, int64_t device_time_ns);
+    /**
+     * Feeds the answer to a time sync ping to the mapping from the server's clock to the device clock, see ServerClock
+     * @param round_trip_ns from sending the ping to getting the answer
+     */
+    void sync_server_clock(int64_t server_time_ns, int64_t round_trip_ns);
+    /**
+     * A sound the server says happened at the given time on its clock, it's scheduled like queue_sound_at so it starts
+     * part way through by however late it arrived, or not at all if it's already over. Until the clock is synced it's
+     * treated as happening now. Dropped if a sound with the same id was predicted or received recently.
+     */
+    void queue_server_sound(SoundType type, glm::vec3 position, int64_t server_time_ns, NetworkEventId event_id);
+    // plays like queue_sound, the id is remembered so the server's copy of the sound doesn't play again
+    void queue_predicted_sound(SoundType type, glm::vec3 position, NetworkEventId event_id);
+    // how long ids are remembered for, it should cover the worst latency from prediction to the server's copy
+    void set_network_event_window(int64_t window_ns);
+    /**
+     * Starts every queued sound and every scheduled sound which is due
+     * @return a handle for each sound started, first the queued sounds in the order they were queued (invalid if the
+     * sound couldn't start), then the queued events, then the scheduled sounds, the reference is valid until the next
+     * call
+     */
+    const std::vector<VoiceHandle> &play_all_sounds();
+    /**
+     * Moves playing sounds, all the changes are applied to the mix at once and the velocities are used for doppler,
+     * handles to sounds which have already finished are skipped
+     */
+    void update_emitters(std::span<const VoiceHandle> handles, std::span<const glm::vec3> positions,
+                         std::span<const glm::vec3> velocities);
+    /**
+     * The pooled voices playing near a point, answered from a grid which is kept up to date as voices start, move and
+     * finish, so OpenAL isn't asked anything. Sounds on the software mixer and named sources aren't included.
+     * @param handles cleared and filled in no particular order
+     */
+    void find_voices_in_radius(glm::vec3 center, float radius, std::vector<VoiceHandle> &handles) const;
+    // @param handles cleared and filled with up to count voices, nearest first
+    void find_nearest_voices(glm::vec3 center, size_t count, std::vector<VoiceHandle> &handles) const;
+    /**
+     * @return the current time of the device clock in nanoseconds, this is the mixer's clock when
+     * ALC_SOFT_device_clock is present and a steady clock otherwise, on a loopback device it's how much has been
+     * rendered
+     */
+    int64_t get_device_clock_time();
+    /**
+     * From now on sounds from queue_sound, queue_sound_at and queue_event are mixed on the cpu and streamed through one
+     * source instead of using a source each, this allows thousands of sounds at once but they can't be moved after
+     * starting. Their attenuation, the gain of their attenuation curve, max_instances and cooldown apply as they do
+     * to pooled voices, but the curve's low pass and reverb send, occlusion and reverb zones don't. Priorities don't
+     * matter as no voice is ever stolen. Every sound type's and event's files are decoded again for the mixer. With
+     * ALC_EXT_thread_local_context the mixer refills its stream on a thread of its own, otherwise it's refilled by
+     * play_all_sounds which then has to be called at least every 50ms.
+     * @param num_threads how many threads mix, 0 uses every core
+     */
+    void enable_software_mixer(unsigned num_threads = 0);
+    bool is_software_mixer_enabled() const;
+    /**
+     * Buses group voices so their volume can be changed together, a voice's gain is multiplied by the gain of its bus
+     * and every bus above it. Gain changes are applied once per frame in play_all_sounds.
+     */
+    BusId create_bus(BusId parent);
+    void set_bus_gain(BusId bus, float gain);
+    float get_bus_gain(BusId bus) const;
+    // sources start out on the sfx bus
+    void set_source_bus(const std::string &source_name, BusId bus);
+    /**
+     * Ducks the rule's target bus while its sidechain bus is loud, the loudness is estimated from the gains of the
+     * voices playing on the bus and evaluated once per play_all_sounds
+     */
+    void add_ducking_rule(const DuckingRule &rule);
+    /**
+     * Voices started after this send to the reverb of the zones nearest to them, needs ALC_EXT_EFX. Only the zones
+     * closest to the listener are active at once since there are few effect slots.
+     */
+    ReverbZoneId add_reverb_zone(const ReverbZone &zone);
+    /**
+     * Sounds behind geometry get muffled by a low-pass filter, the query is asked about a limited number of voices per
+     * frame in turn and the results are kept until that voice comes round again, needs ALC_EXT_EFX
+     */
+    void set_occlusion_query(OcclusionQuery query, const OcclusionSettings &settings = {});
+    // how far ahead of time scheduled sounds are handed to the device when it can delay the start itself
+    void set_schedule_lookahead(int64_t lookahead_ns);
     // NEW
 
     SoundSystem();
+    /**
+     * Renders into memory instead of playing on a device, needs ALC_SOFT_loopback. Time only moves on as audio is
+     * rendered, so together with seed_random everything the system does is reproducible.
+     */
+    explicit SoundSystem(const LoopbackFormat &loopback);
     ~SoundSystem();
 
+    SoundSystem(const SoundSystem &) = delete;
+    SoundSystem &operator=(const SoundSystem &) = delete;
+
+    /**
+     * Makes this system's context current on the calling thread until the binding is destroyed, needs
+     * ALC_EXT_thread_local_context
+     */
+    ThreadContextBinding bind_to_this_thread() const;
+
+    /**
+     * Bakes the curves into lookup tables, events which name the returned id get their gain, low-pass and reverb send
+     * from the curves instead of OpenAL's distance model. The low-pass and reverb send need ALC_EXT_EFX.
+     */
+    AttenuationCurveId add_attenuation_curve(const AttenuationCurveSet &curves);
+
+    /**
+     * Files with more than two channels, eg 5.1 beds or higher order ambisonics, aren't decoded up front but streamed
+     * from disk whenever they're played
+     */
     void load_sound_into_system_for_playback(const std::string &sound_name, const char *filename);
+    /**
+     * Registers a sound whose samples come from the generator as it plays instead of from a file, it's played like any
+     * other loaded sound through play_sound but only on one source at a time. Needs AL_SOFT_callback_buffer.
+     */
+    void load_procedural_sound_into_system_for_playback(const std::string &sound_name, SampleGenerator generator,
+                                                        int sample_rate = 48000);
     void create_sound_source(const std::string &source_name);
     void set_source_gain(const std::string &source_name, float gain);
     void set_source_looping_option(const std::string &source_name, bool looping);
     void play_sound(const std::string &source_name, const std::string &sound_name);
     void set_listener_position(float x, float y, float z);
+    /**
+     * Changes are only sent to OpenAL once they exceed the listener epsilon, so calling this every frame with a still
+     * camera costs no driver calls
+     */
+    void set_listener(glm::vec3 position, glm::vec3 forward, glm::vec3 up, glm::vec3 velocity);
+    void set_listener(const ListenerState &state);
+    /**
+     * For split screen, each voice is heard by the listener nearest to it. OpenAL only has one listener, so it's left
+     * at the origin and each pooled voice's source is moved into the space of its nearest listener, the software mixer
+     * pans for the nearest listener itself. Buffers are shared and a voice is only mixed once however many listeners
+     * there are. The first listener is the one reverb zones follow and get_listener returns, set_listener goes back
+     * to a single listener.
+     *
+     * Only the software mixer culls voices which are inaudible to their nearest listener. Pooled voices keep playing
+     * however far they are from every listener, OpenAL attenuates them as usual and the pool's priorities decide which
+     * ones get a source, so with several listeners spread out the pool should be sized for all of their surroundings.
+     */
+    void set_listeners(std::span<const ListenerState> listeners);
+    /**
+     * Sets the listener part way between two game ticks so that it moves smoothly when rendering faster than the
+     * tick rate
+     * @param alpha how far between the ticks, 0 is the previous tick and 1 is the current one
+     */
+    void set_listener_interpolated(const ListenerState &previous_tick, const ListenerState &current_tick, float alpha);
+    void set_listener_epsilon(float epsilon);
+    void set_error_check_mode(ErrorCheckMode mode);
+    /**
+     * Every loaded sound's loudness is measured, with normalization on each is trimmed towards the target when it
+     * starts so that sounds don't need their gains tuned by hand to match. Changing it applies to sounds started
+     * afterwards.
+     * @param target_loudness in LUFS, it's on by default at default_loudness_target (-23 LUFS, as EBU R128), games
+     * which want their effects louder than broadcast levels usually pick around -18
+     */
+    void set_loudness_normalization(bool enabled, float target_loudness = default_loudness_target);
+    // how files loaded from now on are loaded, eg whether their silence is trimmed
+    void set_load_options(const LoadOptions &options);
+    const ListenerState &get_listener() const;
+
+    bool is_loopback() const;
+    const LoopbackFormat &get_loopback_format() const;
+    // mixes the next frames into interleaved floats with the loopback format's channels
+    void render_loopback(float *interleaved, int num_frames);
+    int64_t get_rendered_frames() const;
+    // seeds the random numbers which pick variations, pitches and gains
+    void seed_random(uint32_t seed);
+    // pooled, named and software mixed voices which are playing
+    size_t get_active_voice_count() const;
+    /**
+     * Every call that changes what plays is recorded until this is called again with nullptr, the random numbers are
+     * reseeded and the seed recorded so the trace can be replayed exactly. Set it before other threads start queueing.
+     */
+    void set_trace_recorder(TraceRecorder *recorder);
 
   private:
+    // a loaded buffer along with the properties needed to start it part way through
+    struct VariationBuffer {
+        ALuint buffer;
+        ALint sample_rate;
+        ALint num_samples;
+        std::string file_path;
+        uint32_t mixer_buffer_id = no_mixer_buffer;
+        float loudness_lufs = unmeasured_loudness;
+        float loudness_trim = 1.0f; // the gain which brings it to the loudness target
+        float loudness = 1.0f;      // linear once trimmed, assumed to be full scale unless measured
+        LoudnessEnvelope loudness_envelope; // untrimmed, empty unless measured
+    };
+
+    /**
+     * The loaded buffers for each variation of a sound type or event, along with the ranges to randomize over and the
+     * limits on how it plays. Sound types get the defaults of SoundEvent for everything SoundVariations doesn't have.
+     */
+    struct SoundTypeBuffers {
+        std::vector<VariationBuffer> buffers;
+        float min_pitch = 1.0f;
+        float max_pitch = 1.0f;
+        float min_gain = 1.0f;
+        float max_gain = 1.0f;
+        BusId bus = buses::sfx;
+        uint8_t priority = 128;
+        uint16_t max_instances = 0;
+        float cooldown = 0.0f;
+        SoundAttenuation attenuation;
+        AttenuationCurveId attenuation_curve = no_attenuation_curve;
+
+        uint32_t num_instances = 0; // playing on pooled voices, the software mixer counts its own by group
+        uint32_t mixer_group = 0;
+        std::chrono::steady_clock::time_point last_start;
+        bool started = false;
+    };
+
+    /**
+     * A pooled source, the generation is bumped every time the sound playing on it finishes. Named sources are voices
+     * too so that they can go through buses, but they are never handed out by the pool.
+     */
+    struct Voice {
+        ALuint source;
+        uint32_t generation = 0;
+        bool active = false;
+        bool named = false;
+        bool looping = false; // named voices only, a stream loops by itself rather than through the source
+        float base_gain = 1.0f; // before the bus gain is applied
+        float loudness = 1.0f;  // of the buffer that's playing
+        float loudness_trim = 1.0f;
+        const LoudnessEnvelope *loudness_envelope = nullptr; // of the buffer that's playing, if it was measured
+        // where the buffer was at start_time and how fast it moves on, so its position is known without asking OpenAL
+        std::chrono::steady_clock::time_point start_time;
+        double start_frame = 0.0;
+        double frames_per_second = 0.0; // the buffer's sample rate times the pitch
+        BusId bus = buses::sfx;
+        glm::vec3 position{0.0f};
+        glm::vec3 velocity{0.0f};
+        ALuint direct_filter = 0; // low-pass, only created once occlusion is enabled
+        float occlusion = 0.0f;   // as of the last time this voice was queried
+        float applied_occlusion = 0.0f;
+        bool occlusion_stale = false; // just started and not queried yet
+        uint8_t priority = 0;
+        SoundTypeBuffers *sound = nullptr; // what's playing, the buffers are never moved once loaded
+        SoundAttenuation attenuation;      // as last set on the source
+        AttenuationCurveId attenuation_curve = no_attenuation_curve;
+        bool distance_model_none = false; // the source ignores distance so the curve can take over
+        AttenuationValues curve_values;   // 1 when there's no curve
+        float applied_low_pass = 1.0f;
+        float applied_reverb_send = 1.0f;
+        ALuint send_filter = 0; // scales the reverb sends, only created for voices with a curve
+
+        float get_gain(float bus_gain) const { return base_gain * loudness_trim * bus_gain * curve_values.gain; }
+    };
+
     std::map<std::string, ALuint> sound_name_to_loaded_buffer;
-    std::map<std::string, ALuint> source_name_to_source_id;
+    std::map<std::string, float> sound_name_to_loudness; // LUFS
+    std::map<std::string, LoudnessEnvelope> sound_name_to_loudness_envelope;
+    std::map<std::string, std::string> sound_name_to_streamed_file;
+    std::map<uint32_t, std::unique_ptr<SoundStream>> voice_index_to_stream; // only named voices stream
+    // OpenAL holds a pointer to these for as long as their callback buffer exists
+    std::vector<std::unique_ptr<SampleGenerator>> procedural_generators;
+    std::map<std::string, uint32_t> source_name_to_voice_index;
 
     // NEW
-    std::vector<ALuint> sound_sources;                   // Pool of sound sources
-    std::unordered_map<SoundType, ALuint> sound_buffers; // Map of sound buffers
-    std::queue<QueuedSound> sound_to_play_queue;         // Queue of sounds to play
-                                                         // NEW
+    std::vector<Voice> voices;                                     // Pool of sound sources
+    std::vector<VoiceHandle> started_voices;                       // Handles returned from play_all_sounds
+    VoiceSpatialHash voice_grid;                                   // where the active pooled voices are
+    mutable std::vector<uint32_t> nearby_voices;
+    std::unordered_map<SoundType, SoundTypeBuffers> sound_buffers; // Map of sound buffers
+    std::queue<QueuedSound> sound_to_play_queue;                   // Queue of sounds to play
+    std::queue<QueuedSound> draining_queue;                        // What play_all_sounds is working through
+    std::vector<QueuedEvent> event_queue;
+    std::vector<QueuedEvent> draining_events;
+    std::vector<SoundTypeBuffers> event_buffers; // indexed by event id
+    std::chrono::steady_clock::time_point frame_time;
+
+    AttenuationTables attenuation_tables;
+    // scratch space for evaluating every voice with a curve in one batch
+    std::vector<uint32_t> curve_voices;
+    std::vector<AttenuationCurveId> curve_ids;
+    std::vector<float> curve_distances;
+    std::vector<float> curve_gains;
+    std::vector<float> curve_low_passes;
+    std::vector<float> curve_reverb_sends;
+    // Scheduled sounds ordered so that the earliest is on top
+    struct LaterDeviceTime {
+        bool operator()(const ScheduledSound &a, const ScheduledSound &b) const {
+            return a.device_time_ns > b.device_time_ns;
+        }
+    };
+    std::priority_queue<ScheduledSound, std::vector<ScheduledSound>, LaterDeviceTime> scheduled_sounds;
+    std::vector<ScheduledSound> due_scheduled_sounds;
+    int64_t schedule_lookahead_ns = 50'000'000;
+
+    // guarded by queue_mutex since network sounds can arrive on any thread
+    ServerClock server_clock;
+    std::unordered_set<NetworkEventId> network_event_ids;
+    std::queue<std::pair<int64_t, NetworkEventId>> network_event_order; // device time each id was first seen
+    int64_t network_event_window_ns = 5'000'000'000;
+    // @return false if the id was already seen, queue_mutex must be held
+    bool remember_network_event(NetworkEventId event_id, int64_t now_ns);
+    std::mt19937 random_number_generator{std::random_device{}()};  // Used to pick variations, pitch and gain
+                                                                   // NEW
+
+    bool loopback = false;
+    LoopbackFormat loopback_format;
+    // written by render_loopback and read by the device clock, which queue_sound_at can ask for from any thread
+    std::atomic<int64_t> rendered_frames{0};
+    TraceRecorder *trace_recorder = nullptr; // not owned
+
+    ListenerState listener_state;           // the most recently requested listener
+    ListenerState submitted_listener_state; // what OpenAL currently has
+    bool listener_submitted = false;
+    float listener_epsilon = 1e-4f;
+    std::vector<ListenerState> split_listeners; // only when there's more than one, see set_listeners
+    // sends the listener to OpenAL, skipping whatever hasn't changed by more than the epsilon
+    void submit_listener(const ListenerState &state);
+    const ListenerState &get_nearest_listener(glm::vec3 position) const;
+    // where a voice's source goes, the position itself unless there are several listeners
+    glm::vec3 get_source_position(glm::vec3 position) const;
+    // the velocity relative to the nearest listener when there are several, otherwise the velocity itself
+    glm::vec3 get_source_velocity(glm::vec3 position, glm::vec3 velocity) const;
+    void reposition_sources();
+
+    ErrorCheckMode error_check_mode = SOUND_SYSTEM_DEFAULT_ERROR_CHECK_MODE;
+
+    LoadOptions load_options;
+    // what the pooled sounds' variations were loaded with, the software mixer's copies are decoded the same way
+    LoadOptions variation_load_options;
+
+    bool loudness_normalization = true;
+    float loudness_target = default_loudness_target; // LUFS
+    float get_loudness_trim(float loudness) const;
+    void update_loudness_trim(VariationBuffer &variation_buffer) const;
+    uint64_t frame_index = 0; // counts calls to play_all_sounds, errors found in deferred mode are reported against it
+    // @return false if the last OpenAL call failed, only ever false in checked mode
+    bool check_al_error(const char *operation);
+    void check_frame_al_error();
+
+    BusGraph bus_graph;
+    std::vector<float> effective_bus_gains; // handed to the software mixer
+    BusDucker bus_ducker;
+    std::vector<float> bus_loudness;
+    std::chrono::steady_clock::time_point last_ducking_update;
+    bool ducking_started = false;
+    // linear and trimmed, at the point the voice has got to
+    float get_current_loudness(const Voice &voice) const;
+
+    std::unique_ptr<SoftwareMixer> software_mixer;
+    uint32_t num_mixer_groups = 0; // every sound type and event is its own group
+    std::unique_ptr<ReverbZoneSystem> reverb_zones;
+    static constexpr int num_reverb_slots = 4;
+
+    OcclusionQuery occlusion_query;
+    OcclusionSettings occlusion_settings;
+    size_t occlusion_cursor = 0; // where the round robin carries on from
+    std::vector<OcclusionRay> occlusion_rays;
+    std::vector<float> occlusion_results;
+    std::vector<uint32_t> occlusion_voices;
+
+    // owned by this system, nothing else destroys them
+    ALCdevice *device = nullptr;
+    ALCcontext *context = nullptr;
+    OpenALExtensions extensions;
+    // queue_sound and queue_sound_at can be called from any thread
+    std::mutex queue_mutex;
 
     // Helper functions
-    ALuint get_available_source();
-    void init_sound_buffers(std::unordered_map<SoundType, std::string> &sound_type_to_file);
+    uint32_t get_available_voice();
+    // stops the lowest priority pooled sound below the given priority, @return its voice or UINT32_MAX if there's none
+    uint32_t steal_voice(uint8_t priority);
+    void release_voice(uint32_t voice_index);
+    void reap_finished_voices();
+    void drain_scheduled_sounds();
+    void apply_bus_gains();
+    void update_ducking();
+    void update_occlusion();
+    void apply_direct_filter(Voice &voice);
+    void update_attenuation_curves();
+    void update_streams();
+    // sets up the curve and distance model of a voice which is about to start
+    void apply_attenuation(Voice &voice, const SoundTypeBuffers &sound);
+    void route_reverb_sends(Voice &voice);
+    Voice &get_named_voice(const std::string &source_name);
+    VoiceHandle start_sound(SoundType type, glm::vec3 position, int64_t late_by_ns = 0,
+                            int64_t play_at_device_time_ns = 0);
+    VoiceHandle start_sound(SoundTypeBuffers &sound, glm::vec3 position, int64_t late_by_ns = 0,
+                            int64_t play_at_device_time_ns = 0);
+    void init_sound_buffers(std::unordered_map<SoundType, SoundVariations> &sound_type_to_variations,
+                            const AssetIndex *asset_index);
+    void init_sound_events(const std::vector<SoundEvent> &events, const AssetIndex *asset_index);
+    // decodes the variations for the software mixer with the options they were loaded with
+    void add_to_software_mixer(const std::vector<VariationBuffer *> &variation_buffers, const LoadOptions &options);
+    // loads each list of files into the matching sound's buffers, all in one parallel batch
+    void load_variation_buffers(
+        const std::vector<std::pair<SoundTypeBuffers *, const std::vector<std::string> *>> &sounds,
+        const AssetIndex *asset_index);
     void init_sound_sources(int num_sources);
 
-    void initialize_openal();
+    void make_context_current();
+    void initialize_openal(const LoopbackFormat *loopback_format = nullptr);
     void deinitialize_openal();
 };
 
@@ -0,0 +1,213 @@
+#include "sound_trace.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr char trace_magic[4] = {'S', 'T', 'R', 'C'};
+constexpr uint32_t trace_version = 1;
+// what the header says until the recorder is closed
+constexpr uint32_t unfinished_trace = UINT32_MAX;
+
+struct TraceHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_entries;
+    uint32_t num_strings;
+};
+
+// followed by num_values floats
+struct EntryRecord {
+    int64_t time_ns;
+    uint32_t id;
+    uint32_t name;
+    uint8_t op;
+    uint8_t flag;
+    uint8_t num_values;
+    uint8_t padding[5] = {};
+};
+
+static_assert(sizeof(TraceHeader) == 16 && sizeof(EntryRecord) == 24);
+
+void write_header(FILE *file, uint32_t num_entries, uint32_t num_strings, const std::string &what) {
+    TraceHeader header;
+    std::memcpy(header.magic, trace_magic, sizeof(trace_magic));
+    header.version = trace_version;
+    header.num_entries = num_entries;
+    header.num_strings = num_strings;
+    write_array(file, &header, 1, what);
+}
+
+} // namespace
+
+SoundTrace read_sound_trace(const std::string &path) {
+    FileHandle file(fopen(path.c_str(), "rb"));
+    if (!file) {
+        fprintf(stderr, "Could not open sound trace %s\n", path.c_str());
+        throw std::runtime_error("couldn't open the sound trace");
+    }
+
+    std::string what = "the sound trace " + path;
+    TraceHeader header;
+    read_array(file.get(), &header, 1, what);
+    if (std::memcmp(header.magic, trace_magic, sizeof(trace_magic)) != 0 || header.version != trace_version) {
+        throw std::runtime_error(path + " isn't a version " + std::to_string(trace_version) + " sound trace");
+    }
+    if (header.num_entries == unfinished_trace) {
+        throw std::runtime_error("the recorder of " + path + " was never closed");
+    }
+
+    SoundTrace trace;
+    trace.entries.resize(header.num_entries);
+    for (TraceEntry &entry : trace.entries) {
+        EntryRecord record;
+        read_array(file.get(), &record, 1, what);
+        if (record.op > (uint8_t)TraceOp::set_listeners || record.num_values > max_trace_values) {
+            throw std::runtime_error(what + " has a corrupt entry");
+        }
+        entry.time_ns = record.time_ns;
+        entry.op = (TraceOp)record.op;
+        entry.id = record.id;
+        entry.name = record.name;
+        entry.flag = record.flag != 0;
+        entry.num_values = record.num_values;
+        read_array(file.get(), entry.values, entry.num_values, what);
+    }
+
+    trace.strings.resize(header.num_strings);
+    for (std::string &string : trace.strings) {
+        uint32_t length;
+        read_array(file.get(), &length, 1, what);
+        string.resize(length);
+        read_array(file.get(), string.data(), length, what);
+    }
+    return trace;
+}
+
+TraceRecorder::TraceRecorder(const std::string &path)
+    : file(fopen(path.c_str(), "wb")), what("the sound trace " + path), start_time(std::chrono::steady_clock::now()) {
+    if (!file) {
+        throw std::runtime_error("couldn't open " + path + " for writing");
+    }
+    write_header(file.get(), unfinished_trace, 0, what);
+}
+
+TraceRecorder::~TraceRecorder() {
+    try {
+        close();
+    } catch (const std::runtime_error &error) {
+        fprintf(stderr, "Could not finish %s: %s\n", what.c_str(), error.what());
+    }
+}
+
+void TraceRecorder::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file) {
+        return;
+    }
+    for (const std::string *string : strings) {
+        uint32_t length = (uint32_t)string->size();
+        write_array(file.get(), &length, 1, what);
+        write_array(file.get(), string->data(), string->size(), what);
+    }
+    // the header goes in last so that a trace which was cut short can't be mistaken for a whole one
+    if (fseek(file.get(), 0, SEEK_SET) != 0) {
+        throw std::runtime_error("failed to write " + what);
+    }
+    write_header(file.get(), num_entries, (uint32_t)strings.size(), what);
+    file.reset();
+}
+
+uint32_t TraceRecorder::intern(const std::string &string) {
+    auto [it, inserted] = string_to_index.try_emplace(string, (uint32_t)strings.size());
+    if (inserted) {
+        strings.push_back(&it->first);
+    }
+    return it->second;
+}
+
+void TraceRecorder::write_entry(TraceOp op, uint32_t id, uint32_t name, bool flag, const float *values,
+                                int num_values) {
+    if (!file) {
+        return;
+    }
+    EntryRecord record;
+    record.time_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+    record.id = id;
+    record.name = name;
+    record.op = (uint8_t)op;
+    record.flag = flag ? 1 : 0;
+    record.num_values = (uint8_t)num_values;
+    write_array(file.get(), &record, 1, what);
+    write_array(file.get(), values, num_values, what);
+    num_entries++;
+}
+
+void TraceRecorder::record_seed(uint32_t seed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    write_entry(TraceOp::seed, seed, 0, false, nullptr, 0);
+}
+
+void TraceRecorder::record_create_sound_source(const std::string &source_name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    write_entry(TraceOp::create_sound_source, 0, intern(source_name), false, nullptr, 0);
+}
+
+void TraceRecorder::record_queue_sound(uint32_t type, glm::vec3 position) {
+    std::lock_guard<std::mutex> lock(mutex);
+    float values[] = {position.x, position.y, position.z};
+    write_entry(TraceOp::queue_sound, type, 0, false, values, 3);
+}
+
+void TraceRecorder::record_queue_event(uint32_t event, glm::vec3 position) {
+    std::lock_guard<std::mutex> lock(mutex);
+    float values[] = {position.x, position.y, position.z};
+    write_entry(TraceOp::queue_event, event, 0, false, values, 3);
+}
+
+void TraceRecorder::record_queue_sound_at(uint32_t type, glm::vec3 position, float lead_seconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    float values[] = {position.x, position.y, position.z, lead_seconds};
+    write_entry(TraceOp::queue_sound_at, type, 0, false, values, 4);
+}
+
+void TraceRecorder::record_play_sound(const std::string &source_name, const std::string &sound_name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    write_entry(TraceOp::play_sound, intern(sound_name), intern(source_name), false, nullptr, 0);
+}
+
+void TraceRecorder::record_listener(const ListenerState &state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    write_listener(TraceOp::set_listener, 0, 0, state);
+}
+
+void TraceRecorder::record_listeners(std::span<const ListenerState> states) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < states.size(); i++) {
+        write_listener(TraceOp::set_listeners, (uint32_t)i, (uint32_t)states.size(), states[i]);
+    }
+}
+
+void TraceRecorder::write_listener(TraceOp op, uint32_t id, uint32_t name, const ListenerState &state) {
+    float values[] = {state.position.x, state.position.y, state.position.z, state.forward.x,
+                      state.forward.y,  state.forward.z,  state.up.x,       state.up.y,
+                      state.up.z,       state.velocity.x, state.velocity.y, state.velocity.z};
+    write_entry(op, id, name, false, values, 12);
+}
+
+void TraceRecorder::record_source_gain(const std::string &source_name, float gain) {
+    std::lock_guard<std::mutex> lock(mutex);
+    write_entry(TraceOp::set_source_gain, 0, intern(source_name), false, &gain, 1);
+}
+
+void TraceRecorder::record_source_looping(const std::string &source_name, bool looping) {
+    std::lock_guard<std::mutex> lock(mutex);
+    write_entry(TraceOp::set_source_looping, 0, intern(source_name), looping, nullptr, 0);
+}
+
+void TraceRecorder::record_play_all_sounds() {
+    std::lock_guard<std::mutex> lock(mutex);
+    write_entry(TraceOp::play_all_sounds, 0, 0, false, nullptr, 0);
+}
@@ -0,0 +1,112 @@
+#ifndef SOUND_TRACE_HPP
+#define SOUND_TRACE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "binary_file.hpp"
+#include "listener_state.hpp"
+
+// the sound system calls which are recorded, along with the seed the system's random numbers were drawn from
+enum class TraceOp : uint8_t {
+    seed,
+    create_sound_source,
+    queue_sound,
+    queue_event,
+    queue_sound_at,
+    play_sound,
+    set_listener,
+    set_source_gain,
+    set_source_looping,
+    play_all_sounds,
+    set_listeners,
+};
+
+constexpr int max_trace_values = 12;
+
+/**
+ * One recorded call, which fields mean anything depends on the op:
+ *  - seed: id is the seed
+ *  - queue_sound and queue_event: id is the sound type or event, values are the position
+ *  - queue_sound_at: as queue_sound, the fourth value is how many seconds ahead of the device clock it was scheduled
+ *  - play_sound: name is the source and id is the sound's name
+ *  - set_listener: values are the position, forward, up and velocity
+ *  - set_listeners: an entry per listener as set_listener, id is the listener's index and name is how many there are
+ *  - set_source_gain and set_source_looping: name is the source, the gain is the first value and looping is the flag
+ * Names and sound names index into the trace's strings.
+ */
+struct TraceEntry {
+    int64_t time_ns; // since the recorder was created
+    TraceOp op;
+    uint32_t id = 0;
+    uint32_t name = 0;
+    bool flag = false;
+    int num_values = 0;
+    float values[max_trace_values] = {};
+
+    glm::vec3 get_vec3(int first) const { return {values[first], values[first + 1], values[first + 2]}; }
+};
+
+struct SoundTrace {
+    std::vector<TraceEntry> entries;
+    std::vector<std::string> strings;
+};
+
+// @throw std::runtime_error if the file is truncated or its recorder was never closed
+SoundTrace read_sound_trace(const std::string &path);
+
+/**
+ * Writes the calls made on a sound system to a file as they happen so they can be replayed later, see
+ * replay_sound_trace. Each call is a small fixed size record followed by its float values, names are written once in a
+ * string table at the end when the recorder is closed.
+ *
+ * Calls can be recorded from any thread since queue_sound and queue_sound_at can be.
+ */
+class TraceRecorder {
+  public:
+    // @throw std::runtime_error if the file can't be opened
+    explicit TraceRecorder(const std::string &path);
+    // closes the trace if it hasn't been already
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+    void record_seed(uint32_t seed);
+    void record_create_sound_source(const std::string &source_name);
+    void record_queue_sound(uint32_t type, glm::vec3 position);
+    void record_queue_event(uint32_t event, glm::vec3 position);
+    // @param lead_seconds how far ahead of the device clock the sound was scheduled, negative if it was already late
+    void record_queue_sound_at(uint32_t type, glm::vec3 position, float lead_seconds);
+    void record_play_sound(const std::string &source_name, const std::string &sound_name);
+    void record_listener(const ListenerState &state);
+    void record_listeners(std::span<const ListenerState> states);
+    void record_source_gain(const std::string &source_name, float gain);
+    void record_source_looping(const std::string &source_name, bool looping);
+    void record_play_all_sounds();
+
+    // writes the string table, nothing more is recorded afterwards
+    void close();
+
+  private:
+    std::mutex mutex;
+    FileHandle file;
+    std::string what; // names the file in errors
+    std::chrono::steady_clock::time_point start_time;
+    uint32_t num_entries = 0;
+    std::unordered_map<std::string, uint32_t> string_to_index;
+    std::vector<const std::string *> strings; // point into string_to_index's keys, in index order
+
+    uint32_t intern(const std::string &string);
+    // the mutex must be held
+    void write_entry(TraceOp op, uint32_t id, uint32_t name, bool flag, const float *values, int num_values);
+    void write_listener(TraceOp op, uint32_t id, uint32_t name, const ListenerState &state);
+};
+
+#endif // SOUND_TRACE_HPP
@@ -0,0 +1,183 @@
+#include "voice_spatial_hash.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+VoiceSpatialHash::VoiceSpatialHash(float cell_size) : cell_size(cell_size), inverse_cell_size(1.0f / cell_size) {
+    assert(cell_size > 0);
+}
+
+glm::ivec3 VoiceSpatialHash::get_cell_coordinates(glm::vec3 position) const {
+    return glm::ivec3(glm::floor(position * inverse_cell_size));
+}
+
+uint64_t VoiceSpatialHash::get_cell_key(glm::ivec3 cell) {
+    // 21 bits per axis, offset so that negative coordinates pack too
+    const uint64_t mask = (1u << 21) - 1;
+    const int64_t offset = 1 << 20;
+    return (((uint64_t)(cell.x + offset) & mask) << 42) | (((uint64_t)(cell.y + offset) & mask) << 21) |
+           ((uint64_t)(cell.z + offset) & mask);
+}
+
+void VoiceSpatialHash::add_to_cell(uint32_t voice, uint64_t cell) {
+    std::vector<uint32_t> &cell_voices = cells[cell];
+    entries[voice].cell = cell;
+    entries[voice].slot = (uint32_t)cell_voices.size();
+    cell_voices.push_back(voice);
+}
+
+void VoiceSpatialHash::remove_from_cell(uint32_t voice) {
+    const Entry &entry = entries[voice];
+    auto cell_it = cells.find(entry.cell);
+    std::vector<uint32_t> &cell_voices = cell_it->second;
+    // the last voice of the cell takes the removed one's slot
+    uint32_t last = cell_voices.back();
+    cell_voices[entry.slot] = last;
+    entries[last].slot = entry.slot;
+    cell_voices.pop_back();
+    if (cell_voices.empty()) {
+        cells.erase(cell_it);
+    }
+}
+
+void VoiceSpatialHash::insert(uint32_t voice, glm::vec3 position) {
+    if (voice >= entries.size()) {
+        entries.resize(voice + 1);
+    }
+    if (entries[voice].present) {
+        move(voice, position);
+        return;
+    }
+    entries[voice].present = true;
+    entries[voice].position = position;
+    add_to_cell(voice, get_cell_key(get_cell_coordinates(position)));
+    num_voices++;
+}
+
+void VoiceSpatialHash::move(uint32_t voice, glm::vec3 position) {
+    assert(contains(voice));
+    Entry &entry = entries[voice];
+    entry.position = position;
+    uint64_t cell = get_cell_key(get_cell_coordinates(position));
+    if (cell != entry.cell) {
+        remove_from_cell(voice);
+        add_to_cell(voice, cell);
+    }
+}
+
+void VoiceSpatialHash::remove(uint32_t voice) {
+    if (!contains(voice)) {
+        return;
+    }
+    remove_from_cell(voice);
+    entries[voice].present = false;
+    num_voices--;
+}
+
+bool VoiceSpatialHash::contains(uint32_t voice) const { return voice < entries.size() && entries[voice].present; }
+
+size_t VoiceSpatialHash::size() const { return num_voices; }
+
+void VoiceSpatialHash::find_in_radius(glm::vec3 center, float radius, std::vector<uint32_t> &out) const {
+    float radius_squared = radius * radius;
+    // a radius much bigger than the cells covers more cells than are occupied, then it's cheaper to look at those
+    float cells_across = 2.0f * radius * inverse_cell_size + 1.0f;
+    if (cells_across * cells_across * cells_across > (float)cells.size()) {
+        for (const auto &[cell, cell_voices] : cells) {
+            for (uint32_t voice : cell_voices) {
+                glm::vec3 offset = entries[voice].position - center;
+                if (glm::dot(offset, offset) <= radius_squared) {
+                    out.push_back(voice);
+                }
+            }
+        }
+        return;
+    }
+
+    glm::ivec3 first = get_cell_coordinates(center - glm::vec3(radius));
+    glm::ivec3 last = get_cell_coordinates(center + glm::vec3(radius));
+    candidates.clear();
+    for (int z = first.z; z <= last.z; z++) {
+        for (int y = first.y; y <= last.y; y++) {
+            for (int x = first.x; x <= last.x; x++) {
+                gather_cell({x, y, z}, center, radius_squared);
+            }
+        }
+    }
+    for (const auto &[distance_squared, voice] : candidates) {
+        out.push_back(voice);
+    }
+}
+
+void VoiceSpatialHash::gather_cell(glm::ivec3 cell, glm::vec3 center, float radius_squared) const {
+    auto cell_it = cells.find(get_cell_key(cell));
+    if (cell_it == cells.end()) {
+        return;
+    }
+    for (uint32_t voice : cell_it->second) {
+        glm::vec3 offset = entries[voice].position - center;
+        float distance_squared = glm::dot(offset, offset);
+        if (distance_squared <= radius_squared) {
+            candidates.push_back({distance_squared, voice});
+        }
+    }
+}
+
+void VoiceSpatialHash::find_nearest(glm::vec3 center, size_t count, std::vector<uint32_t> &out,
+                                    float max_radius) const {
+    out.clear();
+    candidates.clear();
+    if (count == 0 || num_voices == 0) {
+        return;
+    }
+    float radius_squared = max_radius * max_radius;
+    glm::ivec3 center_cell = get_cell_coordinates(center);
+
+    for (int64_t ring = 0;; ring++) {
+        int64_t side = 2 * ring + 1;
+        int64_t shell_cells = ring == 0 ? 1 : side * side * side - (side - 2) * (side - 2) * (side - 2);
+        if (shell_cells > (int64_t)cells.size()) {
+            // the shells have got bigger than the number of occupied cells, so finish by looking at all of them
+            candidates.clear();
+            for (const auto &[cell, cell_voices] : cells) {
+                for (uint32_t voice : cell_voices) {
+                    glm::vec3 offset = entries[voice].position - center;
+                    float distance_squared = glm::dot(offset, offset);
+                    if (distance_squared <= radius_squared) {
+                        candidates.push_back({distance_squared, voice});
+                    }
+                }
+            }
+            break;
+        }
+
+        int r = (int)ring;
+        for (int dz = -r; dz <= r; dz++) {
+            for (int dy = -r; dy <= r; dy++) {
+                // on the top and bottom faces the whole row is in the shell, elsewhere only its two ends
+                bool whole_row = dz == -r || dz == r || dy == -r || dy == r;
+                for (int dx = -r; dx <= r; dx += whole_row ? 1 : std::max(1, 2 * r)) {
+                    gather_cell(center_cell + glm::ivec3(dx, dy, dz), center, radius_squared);
+                }
+            }
+        }
+
+        // every cell not searched yet is at least this far from the center
+        float searched_distance = (float)ring * cell_size;
+        if (searched_distance > max_radius || candidates.size() == num_voices) {
+            break;
+        }
+        if (candidates.size() >= count) {
+            std::nth_element(candidates.begin(), candidates.begin() + (count - 1), candidates.end());
+            if (candidates[count - 1].first <= searched_distance * searched_distance) {
+                break;
+            }
+        }
+    }
+
+    size_t found = std::min(count, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + found, candidates.end());
+    for (size_t i = 0; i < found; i++) {
+        out.push_back(candidates[i].second);
+    }
+}
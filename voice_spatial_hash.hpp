@@ -0,0 +1,62 @@
+#ifndef VOICE_SPATIAL_HASH_HPP
+#define VOICE_SPATIAL_HASH_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * A uniform grid of where the playing voices are, so "which voices are near here" is answered from a few cells
+ * instead of a scan of every voice. Voices are identified by their index in the pool. Moving a voice only touches the
+ * grid when it crosses into another cell, and a cell's voices are removed by swapping with the last one, so every
+ * update is O(1).
+ */
+class VoiceSpatialHash {
+  public:
+    // the cell size should be around the radius usually queried with
+    explicit VoiceSpatialHash(float cell_size = 8.0f);
+
+    void insert(uint32_t voice, glm::vec3 position);
+    void move(uint32_t voice, glm::vec3 position);
+    // does nothing if the voice isn't in the grid
+    void remove(uint32_t voice);
+    bool contains(uint32_t voice) const;
+    size_t size() const;
+
+    // appends every voice within the radius, in no particular order
+    void find_in_radius(glm::vec3 center, float radius, std::vector<uint32_t> &out) const;
+    /**
+     * Searches outwards a shell of cells at a time until no unsearched cell could hold anything nearer
+     * @param out cleared and filled with up to count voices within the radius, nearest first
+     */
+    void find_nearest(glm::vec3 center, size_t count, std::vector<uint32_t> &out, float max_radius = INFINITY) const;
+
+  private:
+    struct Entry {
+        glm::vec3 position;
+        uint64_t cell;
+        uint32_t slot; // where in its cell's list
+        bool present = false;
+    };
+
+    float cell_size;
+    float inverse_cell_size;
+    std::vector<Entry> entries; // indexed by voice
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    size_t num_voices = 0;
+    // scratch for find_nearest
+    mutable std::vector<std::pair<float, uint32_t>> candidates;
+
+    glm::ivec3 get_cell_coordinates(glm::vec3 position) const;
+    static uint64_t get_cell_key(glm::ivec3 cell);
+    void add_to_cell(uint32_t voice, uint64_t cell);
+    void remove_from_cell(uint32_t voice);
+    // adds the voices of the cell which are within the radius to the candidates
+    void gather_cell(glm::ivec3 cell, glm::vec3 center, float radius_squared) const;
+};
+
+#endif // VOICE_SPATIAL_HASH_HPP